@@ -0,0 +1,121 @@
+// Microbenchmarks of the tick engine and of the grid serialization.
+// Arguments are the grid side and the percentage of cells that start occupied.
+
+#include <benchmark/benchmark.h>
+
+#include "frame_codec.h"
+#include "grid_json.h"
+#include "simulation.h"
+
+namespace
+{
+    const uint64_t BENCH_SEED = 42;
+
+    // Starts a side x side grid with `density` percent of the cells split between the species
+    void start_grid(simulation_t &simulation, const benchmark::State &state, uint32_t plants, uint32_t herbivores, uint32_t carnivores)
+    {
+        uint32_t side = state.range(0);
+        uint64_t occupied = uint64_t(side) * side * state.range(1) / 100;
+        uint32_t total = plants + herbivores + carnivores;
+        simulation.start(side, side, occupied * plants / total, occupied * herbivores / total, occupied * carnivores / total, BENCH_SEED);
+    }
+
+    // One tick of a grid populated with the given mix of species. The grid is
+    // restarted outside of the timed region every iteration so that every tick
+    // sees the initial density. Measured in wall time, the work runs on the pool.
+    template <uint32_t plants, uint32_t herbivores, uint32_t carnivores>
+    void BM_tick(benchmark::State &state)
+    {
+        worker_pool_t pool;
+        simulation_t simulation(pool);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            start_grid(simulation, state, plants, herbivores, carnivores);
+            state.ResumeTiming();
+
+            simulation.step();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+    }
+
+    // Neighbor queries of every cell of the grid, as the tick makes them: the
+    // occupied neighbors and the ones holding a given species, from the bitboards
+    void BM_neighbor_mask(benchmark::State &state)
+    {
+        worker_pool_t pool(1);
+        simulation_t simulation(pool);
+        start_grid(simulation, state, 1, 1, 1);
+        const grid_planes_t &planes = simulation.planes();
+
+        for (auto _ : state)
+        {
+            for (uint32_t i = 0; i != simulation.height(); i++)
+                for (uint32_t j = 0; j != simulation.width(); j++)
+                {
+                    size_t idx = size_t(i) * simulation.row_stride() + j;
+                    benchmark::DoNotOptimize(planes.occupied_neighbors(idx));
+                    benchmark::DoNotOptimize(planes.neighbors_of_type(idx, plant));
+                }
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+    }
+
+    // JSON dump of the grid, as returned by /next-iteration
+    void BM_dump_grid_json(benchmark::State &state)
+    {
+        worker_pool_t pool(1);
+        simulation_t simulation(pool);
+        start_grid(simulation, state, 1, 1, 1);
+
+        for (auto _ : state)
+            benchmark::DoNotOptimize(dump_grid_json(simulation));
+        state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+    }
+
+    // Binary keyframe of the grid, as returned by /next-iteration?format=binary
+    void BM_encode_keyframe(benchmark::State &state)
+    {
+        worker_pool_t pool(1);
+        simulation_t simulation(pool);
+        start_grid(simulation, state, 1, 1, 1);
+
+        for (auto _ : state)
+            benchmark::DoNotOptimize(encode_keyframe(simulation));
+        state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+    }
+
+    // Binary delta of one tick
+    void BM_encode_delta(benchmark::State &state)
+    {
+        worker_pool_t pool(1);
+        simulation_t simulation(pool);
+        start_grid(simulation, state, 1, 1, 1);
+        simulation.step();
+
+        for (auto _ : state)
+            benchmark::DoNotOptimize(encode_delta(simulation, simulation.current_tick() - 1));
+        state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+    }
+
+    // Grid sides x occupied percentage
+    void grid_args(benchmark::internal::Benchmark *bench)
+    {
+        bench->ArgNames({"side", "density"});
+        for (int64_t side : {64, 256, 1024})
+            for (int64_t density : {5, 25, 75})
+                bench->Args({side, density});
+    }
+}
+
+BENCHMARK(BM_tick<1, 0, 0>)->Name("BM_tick_plants")->Apply(grid_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_tick<0, 1, 0>)->Name("BM_tick_herbivores")->Apply(grid_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_tick<0, 0, 1>)->Name("BM_tick_carnivores")->Apply(grid_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_tick<6, 3, 1>)->Name("BM_tick_mixed")->Apply(grid_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_neighbor_mask)->Apply(grid_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_dump_grid_json)->Apply(grid_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_encode_keyframe)->Apply(grid_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_encode_delta)->Apply(grid_args)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
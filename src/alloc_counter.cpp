@@ -0,0 +1,41 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Replacements of the global operator new that count the allocations of every
+// thread. The array and nothrow forms of the standard library forward to these.
+// A thread-local counter keeps the cost at one increment per allocation.
+
+namespace
+{
+    thread_local uint64_t heap_allocations = 0;
+}
+
+uint64_t thread_heap_allocations()
+{
+    return heap_allocations;
+}
+
+void *operator new(std::size_t size)
+{
+    heap_allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    heap_allocations++;
+    // aligned_alloc wants a size that is a multiple of the alignment
+    std::size_t align = std::size_t(alignment);
+    if (void *p = std::aligned_alloc(align, size ? (size + align - 1) / align * align : align))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
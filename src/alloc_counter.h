@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of heap allocations (calls to any form of operator new) made by the
+// calling thread since it started. The engine samples it around ticks to
+// check that they do not allocate; see tick_metrics_t::last_tick_allocations.
+uint64_t thread_heap_allocations();
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+// Size of a cache line, used to align and pad the grid buffers
+const size_t CACHE_LINE_SIZE = 64;
+
+// Memory of a simulation: a single block, sized up front from the grid
+// dimensions, from which its buffers are carved in order. Nothing is freed on
+// its own; reset() and the destructor release the whole block at once.
+class arena_t
+{
+public:
+    arena_t() = default;
+    ~arena_t() { release(); }
+
+    arena_t(const arena_t &) = delete;
+    arena_t &operator=(const arena_t &) = delete;
+
+    // Bytes taken by a buffer of `n` T, every buffer starting on a cache line
+    template <typename T>
+    static size_t footprint(size_t n)
+    {
+        return (n * sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    }
+
+    // Allocates a block of `bytes` and releases the current one, so everything
+    // allocated from it. If the allocation throws the current block is kept.
+    void reset(size_t bytes)
+    {
+        std::byte *new_block = static_cast<std::byte *>(::operator new(bytes, std::align_val_t(CACHE_LINE_SIZE)));
+        release();
+        block = new_block;
+        capacity = bytes;
+    }
+
+    // Throws std::bad_alloc past the size given to reset()
+    void *allocate(size_t bytes)
+    {
+        size_t size = footprint<std::byte>(bytes);
+        if (size > capacity - used)
+            throw std::bad_alloc();
+
+        void *p = block + used;
+        used += size;
+        return p;
+    }
+
+    size_t size() const { return capacity; }
+
+private:
+    void release()
+    {
+        if (block)
+            ::operator delete(block, std::align_val_t(CACHE_LINE_SIZE));
+        block = nullptr;
+        capacity = 0;
+        used = 0;
+    }
+
+    std::byte *block = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+};
+
+// Allocator of containers that live in an arena_t. Deallocating is a no-op,
+// the memory comes back when the arena is reset. Containers take the arena
+// of the container moved or swapped into them.
+template <typename T>
+struct arena_allocator
+{
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    arena_t *arena = nullptr;
+
+    arena_allocator() = default;
+    explicit arena_allocator(arena_t &arena) : arena(&arena) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T))); }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const arena_allocator<U> &other) const { return arena == other.arena; }
+};
@@ -0,0 +1,148 @@
+// Headless batch runner: runs the tick engine without the web server and
+// prints a CSV summary of the run, for parameter sweeps.
+//
+// Usage: ecosim_batch [--width W] [--height H] [--plants N] [--herbivores N]
+//                     [--carnivores N] [--seed S] [--ticks N] [--workers N]
+//                     [--params JSON]
+//
+// --params takes the same parameter block as /start-simulation (see params_json.h).
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "params_json.h"
+#include "simulation.h"
+
+struct batch_options_t
+{
+    uint32_t width = DEFAULT_GRID_SIZE;
+    uint32_t height = DEFAULT_GRID_SIZE;
+    uint32_t num_plant = 10;
+    uint32_t num_herbi = 5;
+    uint32_t num_carni = 2;
+    uint64_t seed = 0;
+    uint32_t ticks = 100;
+    size_t num_workers = std::thread::hardware_concurrency();
+    simulation_params_t params;
+};
+
+// Number of entities and totals of energy and age of one species
+struct species_summary_t
+{
+    uint64_t count = 0;
+    int64_t total_energy = 0;
+    int64_t total_age = 0;
+};
+
+bool parse_options(int argc, char *argv[], batch_options_t &options)
+{
+    for (int idx = 1; idx < argc; idx++)
+    {
+        if (idx + 1 >= argc)
+            return false;
+
+        const char *name = argv[idx];
+        const char *value = argv[++idx];
+        if (std::strcmp(name, "--width") == 0)
+            options.width = std::stoul(value);
+        else if (std::strcmp(name, "--height") == 0)
+            options.height = std::stoul(value);
+        else if (std::strcmp(name, "--plants") == 0)
+            options.num_plant = std::stoul(value);
+        else if (std::strcmp(name, "--herbivores") == 0)
+            options.num_herbi = std::stoul(value);
+        else if (std::strcmp(name, "--carnivores") == 0)
+            options.num_carni = std::stoul(value);
+        else if (std::strcmp(name, "--seed") == 0)
+            options.seed = std::stoull(value);
+        else if (std::strcmp(name, "--ticks") == 0)
+            options.ticks = std::stoul(value);
+        else if (std::strcmp(name, "--workers") == 0)
+            options.num_workers = std::stoul(value);
+        else if (std::strcmp(name, "--params") == 0)
+        {
+            std::string error;
+            if (!params_from_json(nlohmann::json::parse(value), options.params, error))
+                throw std::invalid_argument(error);
+        }
+        else
+            return false;
+    }
+
+    return options.width != 0 and options.height != 0 and options.width <= MAX_GRID_SIZE and options.height <= MAX_GRID_SIZE and
+           uint64_t(options.num_plant) + options.num_herbi + options.num_carni <= uint64_t(options.width) * options.height;
+}
+
+int main(int argc, char *argv[])
+{
+    batch_options_t options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+            throw std::invalid_argument("invalid options");
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        std::fprintf(stderr, "usage: %s [--width W] [--height H] [--plants N] [--herbivores N] [--carnivores N] "
+                             "[--seed S] [--ticks N] [--workers N] [--params JSON]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    worker_pool_t pool(options.num_workers);
+    simulation_t simulation(pool);
+    simulation.start(options.width, options.height, options.num_plant, options.num_herbi, options.num_carni, options.seed, options.params);
+
+    auto run_start = std::chrono::steady_clock::now();
+    for (uint32_t tick = 0; tick != options.ticks; tick++)
+        simulation.step();
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    // Summary of the final grid. The checksum (FNV-1a of every cell) tells
+    // whether two runs ended in the same state.
+    species_summary_t species[NUM_SPECIES + 1];
+    uint64_t checksum = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i != simulation.height(); i++)
+    {
+        for (uint32_t j = 0; j != simulation.width(); j++)
+        {
+            entity_t entity = simulation.at(i, j);
+            species_summary_t &summary = species[entity.type];
+            summary.count++;
+            summary.total_energy += entity.energy;
+            summary.total_age += entity.age;
+
+            for (int32_t field : {int32_t(entity.type), entity.energy, entity.age})
+                checksum = (checksum ^ uint32_t(field)) * 0x100000001b3ULL;
+        }
+    }
+
+    // Population of every species, then mean energy of the ones that use it
+    std::printf("width,height,seed,workers,ticks,elapsed_s,ticks_per_s,");
+    for_each_species([](auto traits)
+                     { std::printf("%ss,", traits.name); });
+    for_each_species([](auto traits)
+                     {
+        if (traits.needs_energy)
+            std::printf("mean_%s_energy,", traits.name); });
+    std::printf("checksum\n");
+
+    std::printf("%u,%u,%llu,%zu,%u,%.6f,%.2f,",
+                options.width, options.height, (unsigned long long)options.seed, pool.size(), options.ticks,
+                elapsed_s, elapsed_s > 0 ? options.ticks / elapsed_s : 0.0);
+    for_each_species([&](auto traits)
+                     { std::printf("%llu,", (unsigned long long)species[traits.type].count); });
+    for_each_species([&](auto traits)
+                     {
+        const species_summary_t &summary = species[traits.type];
+        if (traits.needs_energy)
+            std::printf("%.2f,", summary.count ? double(summary.total_energy) / summary.count : 0.0); });
+    std::printf("%016llx\n", (unsigned long long)checksum);
+
+    return 0;
+}
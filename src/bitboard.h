@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "arena.h"
+
+// Bit per cell of the grid, in the padded row-major layout of the planes.
+// A row of zero words is kept above and below the grid, so the neighbors of
+// any cell, including the ones on the border, can be read without bounds checks.
+using bitboard_t = std::vector<uint64_t, arena_allocator<uint64_t>>;
+
+// Bitmask of the directions (right, left, down, up) in which the neighbor of
+// the cell at bit `bit` is set in `words`, rows being `stride` bits long.
+// Neighbors across the left and right edges of the grid are not masked out.
+inline uint32_t neighbor_mask(const uint64_t *words, size_t bit, size_t stride)
+{
+#ifdef __AVX2__
+    // The words holding the four neighbors are gathered in one go and every
+    // lane moves the bit of its neighbor to its sign bit
+    __m256i bits = _mm256_add_epi64(_mm256_set1_epi64x(int64_t(bit)), _mm256_setr_epi64x(1, -1, int64_t(stride), -int64_t(stride)));
+    __m256i lanes = _mm256_i64gather_epi64(reinterpret_cast<const long long *>(words), _mm256_srli_epi64(bits, 6), 8);
+    __m256i shifts = _mm256_andnot_si256(bits, _mm256_set1_epi64x(63));
+    return uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_sllv_epi64(lanes, shifts))));
+#else
+    auto bit_at = [words](size_t at)
+    { return uint32_t(words[at / 64] >> (at % 64)) & 1; };
+    return bit_at(bit + 1) | bit_at(bit - 1) << 1 | bit_at(bit + stride) << 2 | bit_at(bit - stride) << 3;
+#endif
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// SplitMix64 finalizer
+constexpr uint64_t splitmix64_mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Threshold of cell_rng_t::chance() for probability `p`, in [0, 1].
+// Probability 1 maps to 2^32, which every 32-bit draw is below.
+constexpr uint64_t probability_threshold(double p)
+{
+    return uint64_t(p * 4294967296.0);
+}
+
+// Counter-based random stream keyed by (seed, tick, cell, stream).
+// Every cell gets its own streams each tick, so the draws are free of shared
+// state and do not depend on which worker runs the cell or in what order.
+// `stream` tells apart the independent draws made for the same cell.
+//
+// The part of the key shared by every cell, stream_key(), is computed once
+// per tick. Decisions compare raw 32-bit draws against integer thresholds
+// (chance()) and picks use a multiply-shift (below()), so the hot path does
+// no floating point.
+class cell_rng_t
+{
+public:
+    using result_type = uint64_t;
+
+    static constexpr uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+    // Key of the stream `stream` of every cell in a tick
+    static constexpr uint64_t stream_key(uint64_t seed, uint32_t tick, uint32_t stream)
+    {
+        return splitmix64_mix(seed ^ splitmix64_mix((uint64_t(stream) << 32 | tick) + GOLDEN_GAMMA));
+    }
+
+    cell_rng_t(uint64_t key, uint32_t i, uint32_t j)
+        : state(key ^ splitmix64_mix((uint64_t(i) << 32 | j) + 2 * GOLDEN_GAMMA))
+    {
+    }
+
+    result_type operator()()
+    {
+        state += GOLDEN_GAMMA;
+        return splitmix64_mix(state);
+    }
+
+    // Draws true with probability threshold / 2^32 (see probability_threshold())
+    bool chance(uint64_t threshold) { return (operator()() >> 32) < threshold; }
+
+    // Uniform draw in [0, n)
+    uint32_t below(uint32_t n) { return uint32_t(((operator()() >> 32) * n) >> 32); }
+
+private:
+    uint64_t state;
+};
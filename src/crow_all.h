@@ -3725,6 +3725,8 @@ namespace crow
             virtual void send_pong(const std::string& msg) = 0;
             virtual void close(const std::string& msg = "quit") = 0;
             virtual std::string get_remote_ip() = 0;
+            /// The io_service of the thread the connection runs on, where its handlers are called.
+            virtual boost::asio::io_service& get_io_service() = 0;
             virtual ~connection() {}
 
             void userdata(void* u) { userdata_ = u; }
@@ -3803,6 +3805,11 @@ namespace crow
                 start(crow::utility::base64encode((unsigned char*)digest, 20));
             }
 
+            boost::asio::io_service& get_io_service() override
+            {
+                return adaptor_.get_io_service();
+            }
+
             /// Send data through the socket.
             template<typename CompletionHandler>
             void dispatch(CompletionHandler handler)
@@ -11439,6 +11446,17 @@ namespace crow
 
             prepare_buffers();
 
+            if (!adaptor_.is_open())
+            {
+                // The client went away before the response was completed
+                res.clear();
+                buffers_.clear();
+                parser_.clear();
+                CROW_LOG_DEBUG << this << " from complete_request (socket is closed)";
+                check_destroy();
+                return;
+            }
+
             if (res.is_static_type())
             {
                 do_write_static();
@@ -11566,9 +11584,10 @@ namespace crow
         void do_write_static()
         {
             is_writing = true;
-            boost::asio::write(adaptor_.socket(), buffers_);
+            // Errors are reported by do_write_sync: the client may be gone
+            bool sent = do_write_sync(buffers_);
 
-            if (res.file_info.statResult == 0)
+            if (sent && res.file_info.statResult == 0)
             {
                 std::ifstream is(res.file_info.path.c_str(), std::ios::in | std::ios::binary);
                 std::vector<boost::asio::const_buffer> buffers{1};
@@ -11577,11 +11596,17 @@ namespace crow
                 while (is.gcount() > 0)
                 {
                     buffers[0] = boost::asio::buffer(buf, is.gcount());
-                    do_write_sync(buffers);
+                    if (!do_write_sync(buffers))
+                        break;
                     is.read(buf, sizeof(buf));
                 }
             }
             is_writing = false;
+            res.end();
+            res.clear();
+            buffers_.clear();
+            parser_.clear();
+            // Last: check_destroy() may delete the connection
             if (close_connection_)
             {
                 adaptor_.shutdown_readwrite();
@@ -11589,11 +11614,6 @@ namespace crow
                 CROW_LOG_DEBUG << this << " from write (static)";
                 check_destroy();
             }
-
-            res.end();
-            res.clear();
-            buffers_.clear();
-            parser_.clear();
         }
 
         void do_write_general()
@@ -11615,31 +11635,36 @@ namespace crow
             else
             {
                 is_writing = true;
-                boost::asio::write(adaptor_.socket(), buffers_); // Write the response start / headers
-                if (res.body.length() > 0)
+                bool sent = do_write_sync(buffers_); // Write the response start / headers
+                if (sent && res.body.length() > 0)
                 {
-                    std::string buf;
                     std::vector<asio::const_buffer> buffers;
 
-                    while (res.body.length() > 16384)
+                    // Chunks are written in place: copying the rest of the body
+                    // after every chunk made large bodies quadratic
+                    size_t offset = 0;
+                    while (sent && res.body.length() - offset > 16384)
                     {
-                        //buf.reserve(16385);
-                        buf = res.body.substr(0, 16384);
-                        res.body = res.body.substr(16384);
                         buffers.clear();
-                        buffers.push_back(boost::asio::buffer(buf));
+                        buffers.push_back(boost::asio::buffer(res.body.data() + offset, 16384));
+                        sent = do_write_sync(buffers);
+                        offset += 16384;
+                    }
+                    // Send whatever is left (at most 16KB) down the socket
+                    if (sent)
+                    {
+                        buffers.clear();
+                        buffers.push_back(boost::asio::buffer(res.body.data() + offset, res.body.length() - offset));
                         do_write_sync(buffers);
                     }
-                    // Collect whatever is left (less than 16KB) and send it down the socket
-                    // buf.reserve(is.length());
-                    buf = res.body;
                     res.body.clear();
-
-                    buffers.clear();
-                    buffers.push_back(boost::asio::buffer(buf));
-                    do_write_sync(buffers);
                 }
                 is_writing = false;
+                res.end();
+                res.clear();
+                buffers_.clear();
+                parser_.clear();
+                // Last: check_destroy() may delete the connection
                 if (close_connection_)
                 {
                     adaptor_.shutdown_readwrite();
@@ -11647,11 +11672,12 @@ namespace crow
                     CROW_LOG_DEBUG << this << " from write (res_stream)";
                     check_destroy();
                 }
-
-                res.end();
-                res.clear();
-                buffers_.clear();
-                parser_.clear();
+                else if (need_to_start_read_after_complete_)
+                {
+                    need_to_start_read_after_complete_ = false;
+                    start_deadline();
+                    do_read();
+                }
             }
         }
 
@@ -11680,14 +11706,18 @@ namespace crow
                       adaptor_.close();
                       is_reading = false;
                       CROW_LOG_DEBUG << this << " from read(1) with description: \"" << http_errno_description(static_cast<http_errno>(parser_.http_errno)) << '\"';
-                      check_destroy();
+                      // A handler that completes later still holds req_ and res:
+                      // the write of its response destroys the connection
+                      if (!need_to_call_after_handlers_)
+                          check_destroy();
                   }
                   else if (close_connection_)
                   {
                       cancel_deadline_timer();
                       parser_.done();
                       is_reading = false;
-                      check_destroy();
+                      if (!need_to_call_after_handlers_)
+                          check_destroy();
                       // adaptor will close after write
                   }
                   else if (!need_to_call_after_handlers_)
@@ -11732,22 +11762,26 @@ namespace crow
               });
         }
 
-        inline void do_write_sync(std::vector<asio::const_buffer>& buffers)
+        /// Returns false if the buffers could not be sent
+        inline bool do_write_sync(std::vector<asio::const_buffer>& buffers)
         {
-
-            boost::asio::write(adaptor_.socket(), buffers, [&](std::error_code ec, std::size_t) {
-                if (!ec)
-                {
-                    return false;
-                }
-                else
-                {
-                    CROW_LOG_ERROR << ec << " - happened while sending buffers";
-                    CROW_LOG_DEBUG << this << " from write (sync)(2)";
-                    check_destroy();
-                    return true;
-                }
-            });
+            boost::system::error_code write_ec;
+            boost::asio::write(
+              adaptor_.socket(), buffers, [&](std::error_code ec, std::size_t) {
+                  if (!ec)
+                  {
+                      return false;
+                  }
+                  else
+                  {
+                      CROW_LOG_ERROR << ec << " - happened while sending buffers";
+                      CROW_LOG_DEBUG << this << " from write (sync)(2)";
+                      check_destroy();
+                      return true;
+                  }
+              },
+              write_ec);
+            return !write_ec;
         }
 
         void check_destroy()
@@ -0,0 +1,92 @@
+#include "frame_codec.h"
+
+namespace
+{
+    const size_t HEADER_SIZE = 22;
+
+    void put_u16(std::string &out, uint16_t v)
+    {
+        out.push_back(char(v));
+        out.push_back(char(v >> 8));
+    }
+
+    void put_u32(std::string &out, uint32_t v)
+    {
+        put_u16(out, uint16_t(v));
+        put_u16(out, uint16_t(v >> 16));
+    }
+
+    void put_varint(std::string &out, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back(char(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(char(v));
+    }
+
+    void put_zigzag(std::string &out, int32_t v)
+    {
+        put_varint(out, (uint32_t(v) << 1) ^ uint32_t(v >> 31));
+    }
+
+    // Writes the header and a record for every cell accepted by `selected`
+    template <typename select_t>
+    std::string encode(const simulation_t &simulation, uint8_t flags, uint32_t base_tick, select_t selected)
+    {
+        const grid_planes_t &planes = simulation.planes();
+
+        std::string out;
+        out.reserve(HEADER_SIZE);
+        out.push_back(char(FRAME_VERSION));
+        out.push_back(char(flags));
+        put_u16(out, uint16_t(simulation.width()));
+        put_u16(out, uint16_t(simulation.height()));
+        put_u32(out, simulation.current_run());
+        put_u32(out, simulation.current_tick());
+        put_u32(out, base_tick);
+        put_u32(out, 0);
+
+        uint32_t num_records = 0;
+        uint64_t next_cell = 0;
+        for (uint32_t i = 0; i != simulation.height(); i++)
+        {
+            size_t row = size_t(i) * simulation.row_stride();
+            for (uint32_t j = 0; j != simulation.width(); j++)
+            {
+                size_t idx = row + j;
+                if (!selected(planes, idx))
+                    continue;
+
+                uint64_t cell = uint64_t(i) * simulation.width() + j;
+                put_varint(out, cell - next_cell);
+                next_cell = cell + 1;
+
+                out.push_back(char(planes.type[idx]));
+                if (planes.type[idx] != empty)
+                {
+                    put_zigzag(out, planes.energy[idx]);
+                    put_varint(out, uint32_t(planes.age[idx]));
+                }
+                num_records++;
+            }
+        }
+
+        for (size_t b = 0; b != 4; b++)
+            out[HEADER_SIZE - 4 + b] = char(num_records >> (8 * b));
+        return out;
+    }
+}
+
+std::string encode_keyframe(const simulation_t &simulation)
+{
+    return encode(simulation, FRAME_KEYFRAME, simulation.current_tick(), [](const grid_planes_t &planes, size_t idx)
+                  { return planes.type[idx] != empty; });
+}
+
+std::string encode_delta(const simulation_t &simulation, uint32_t base_tick)
+{
+    return encode(simulation, 0, base_tick, [base_tick](const grid_planes_t &planes, size_t idx)
+                  { return planes.last_tick[idx] > base_tick; });
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "simulation.h"
+
+// Binary grid frames, a compact alternative to the JSON grid.
+//
+// Integers are little-endian; varints are LEB128 and signed values are
+// zigzag encoded. A frame is a header followed by one record per cell.
+//
+// Header:
+//   u8  FRAME_VERSION
+//   u8  flags (FRAME_KEYFRAME: every cell without a record is empty)
+//   u16 width, u16 height
+//   u32 run, u32 tick, u32 base_tick (tick the records are relative to;
+//       the current tick for keyframes)
+//   u32 number of records
+// Record, in row-major order:
+//   varint gap (cell index i * width + j, minus the previous index plus one)
+//   u8     type
+//   varint energy (zigzag), varint age (only when type != empty)
+const uint8_t FRAME_VERSION = 1;
+const uint8_t FRAME_KEYFRAME = 1;
+
+// Encodes every non-empty cell of the grid
+std::string encode_keyframe(const simulation_t &simulation);
+
+// Encodes the cells that changed after `base_tick` of the current run
+std::string encode_delta(const simulation_t &simulation, uint32_t base_tick);
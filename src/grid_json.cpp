@@ -0,0 +1,42 @@
+#include "grid_json.h"
+
+#include <charconv>
+
+namespace
+{
+    // Longest cell with its separator: ,{"age":-32768,"energy":-32768,"type":"P"}
+    const size_t MAX_CELL_CHARS = 42;
+
+    void append_int(std::string &out, int32_t value)
+    {
+        char digits[12];
+        char *end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        out.append(digits, end);
+    }
+}
+
+std::string dump_grid_json(const simulation_t &simulation)
+{
+    std::string out;
+    out.reserve(size_t(simulation.height()) * (size_t(simulation.width()) * MAX_CELL_CHARS + 3) + 2);
+
+    out += '[';
+    for (uint32_t i = 0; i != simulation.height(); i++)
+    {
+        out += i == 0 ? "[" : ",[";
+        for (uint32_t j = 0; j != simulation.width(); j++)
+        {
+            entity_t e = simulation.at(i, j);
+            out += j == 0 ? "{\"age\":" : ",{\"age\":";
+            append_int(out, e.age);
+            out += ",\"energy\":";
+            append_int(out, e.energy);
+            out += ",\"type\":\"";
+            out += ENTITY_SYMBOLS[e.type];
+            out += "\"}";
+        }
+        out += ']';
+    }
+    out += ']';
+    return out;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "simulation.h"
+
+// Writes the grid as a JSON array of rows of {"age", "energy", "type"} objects,
+// skipping the row padding. The text is written straight into the string, as
+// a document object per cell takes several times the memory of the grid.
+std::string dump_grid_json(const simulation_t &simulation);
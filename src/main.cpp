@@ -3,274 +3,538 @@
 
 #include "crow_all.h"
 #include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <string>
 #include <thread>
-#include <condition_variable>
-#include <mutex>
-
-static const uint32_t NUM_ROWS = 15;
-
-// Constants
-const uint32_t PLANT_MAXIMUM_AGE = 10;
-const uint32_t HERBIVORE_MAXIMUM_AGE = 50;
-const uint32_t CARNIVORE_MAXIMUM_AGE = 80;
-const uint32_t MAXIMUM_ENERGY = 200;
-const uint32_t THRESHOLD_ENERGY_FOR_REPRODUCTION = 20;
-const uint32_t MOVE_ENERGY = 5;
-const uint32_t CARNIVORE_ENERGY_GAIN = 20;
-const uint32_t HERBIVORE_ENERGY_GAIN = 30;
-const uint32_t REPRODUCTION_ENERGY = 10;
-const uint32_t START_ENERGY = 100;
-
-
-// Probabilities
-const double PLANT_REPRODUCTION_PROBABILITY = 0.2;
-const double HERBIVORE_REPRODUCTION_PROBABILITY = 0.075;
-const double CARNIVORE_REPRODUCTION_PROBABILITY = 0.025;
-const double HERBIVORE_MOVE_PROBABILITY = 0.7;
-const double HERBIVORE_EAT_PROBABILITY = 0.9;
-const double CARNIVORE_MOVE_PROBABILITY = 0.5;
-const double CARNIVORE_EAT_PROBABILITY = 1.0;
-
-// Type definitions
-enum entity_type_t
-{
-    empty,
-    plant,
-    herbivore,
-    carnivore
-};
-
-struct pos_t
+#include <unordered_map>
+#include <utility>
+
+#include "frame_codec.h"
+#include "grid_json.h"
+#include "params_json.h"
+#include "simulation.h"
+#include "ticker.h"
+
+// How the client wants the grid, read from its request. Responses written on
+// the ticker thread use a copy, as their request may be gone by then.
+struct grid_format_t
 {
-    uint32_t i;
-    uint32_t j;
-
-	pos_t(int i, int j) : i(i), j(j) {};
-	pos_t() {};
-    
+    explicit grid_format_t(const crow::request &req);
+
+    // Binary frames, with `Accept: application/octet-stream` or `?format=binary`
+    bool binary;
+    // The grid in the response, unless the client sent `?grid=false`
+    bool grid;
+    // Run and tick of the last frame the client applied, if it sent `run` and `since`
+    bool has_base;
+    unsigned long run;
+    unsigned long since;
 };
 
-struct entity_t
+grid_format_t::grid_format_t(const crow::request &req)
 {
-    entity_type_t type;
-    int32_t energy;
-    int32_t age;
-};
-
-// Auxiliary code to convert the entity_type_t enum to a string
-NLOHMANN_JSON_SERIALIZE_ENUM(entity_type_t, {
-                                                {empty, " "},
-                                                {plant, "P"},
-                                                {herbivore, "H"},
-                                                {carnivore, "C"},
-                                            })
+    const char *format = req.url_params.get("format");
+    binary = format ? std::strcmp(format, "binary") == 0
+                    : req.get_header_value("Accept").find("application/octet-stream") != std::string::npos;
+
+    const char *grid_param = req.url_params.get("grid");
+    grid = !grid_param or std::strcmp(grid_param, "false") != 0;
+
+    const char *run_param = req.url_params.get("run");
+    const char *since_param = req.url_params.get("since");
+    has_base = run_param and since_param;
+    run = has_base ? std::strtoul(run_param, nullptr, 10) : 0;
+    since = has_base ? std::strtoul(since_param, nullptr, 10) : 0;
+}
 
-// Auxiliary code to convert the entity_t struct to a JSON object
-namespace nlohmann
+// Writes the grid to the response in the format the client asked for.
+// Binary clients that send the `run` and `since` (tick of the last frame they
+// applied) get only the cells that changed since then, the rest a keyframe.
+void write_grid(const grid_format_t &format, crow::response &res, const simulation_t &simulation)
 {
-    void to_json(nlohmann::json &j, const entity_t &e)
+    if (!format.binary)
     {
-        j = nlohmann::json{{"type", e.type}, {"energy", e.energy}, {"age", e.age}};
+        res.body = dump_grid_json(simulation);
+        return;
     }
-}
-
-// Grid that contains the entities
-static std::vector<std::vector<entity_t>> entity_grid;
 
-std::default_random_engine gen;
-std::uniform_int_distribution<> rand_pos(0, NUM_ROWS - 1);
-std::uniform_real_distribution<> mp_rand(0.0, 1.0);
+    res.set_header("Content-Type", "application/octet-stream");
+    if (format.has_base and format.run == simulation.current_run() and format.since <= simulation.current_tick())
+        res.body = encode_delta(simulation, format.since);
+    else
+        res.body = encode_keyframe(simulation);
+}
 
-std::atomic<int> thread_counter = 0;
-std::atomic<int> completion_counter = 0;
-std::atomic<int> current_it = 0;
+// Population statistics of every species after tick `tick`, for clients that do
+// not need the grid. Energy is left out for species that do not use it, and
+// the mean, min and max are null for extinct species.
+nlohmann::json stats_to_json(uint32_t tick, const population_stats_t &stats)
+{
+    nlohmann::json json_stats = {{"tick", tick}};
+    uint64_t predation = 0;
+    for_each_species([&](auto traits)
+                     {
+        const species_stats_t &species = stats.of(traits.type);
+        auto summary = [&species](int64_t total, int32_t min, int32_t max) -> nlohmann::json
+        {
+            if (species.count == 0)
+                return {{"mean", nullptr}, {"min", nullptr}, {"max", nullptr}};
+            return {{"mean", double(total) / species.count}, {"min", min}, {"max", max}};
+        };
+
+        nlohmann::json json_species = {
+            {"count", species.count},
+            {"age", summary(species.total_age, species.min_age, species.max_age)},
+            {"births", species.births},
+            {"deaths", species.deaths},
+            {"eaten", species.eaten},
+        };
+        if (traits.needs_energy)
+            json_species["energy"] = summary(species.total_energy, species.min_energy, species.max_energy);
+
+        json_stats[traits.name] = std::move(json_species);
+        predation += species.eaten; });
+
+    json_stats["predation"] = predation;
+    return json_stats;
+}
 
-std::mutex exec_it_mtx;
-std::condition_variable exec_it;
+// Range of the tick rates other than 0 and "max". The ticker turns the rate
+// into a period, which does not fit in a clock duration for tiny rates.
+const double MIN_TICK_RATE = 1e-3;
+const double MAX_TICK_RATE = 1e6;
 
-bool new_it(int my_it) {
-    return my_it != (current_it + 1);
+// Reads a tick rate: a number of ticks per second (0 pauses, otherwise between
+// MIN_TICK_RATE and MAX_TICK_RATE) or "max" to run ticks back to back.
+// Returns whether `value` is a valid rate.
+bool parse_rate(const nlohmann::json &value, double &rate)
+{
+    if (value.is_string() and value.get<std::string>() == "max")
+        rate = ticker_t::UNLIMITED_RATE;
+    else if (value.is_number() and (value.get<double>() == 0 or
+                                    (value.get<double>() >= MIN_TICK_RATE and value.get<double>() <= MAX_TICK_RATE)))
+        rate = value.get<double>();
+    else
+        return false;
+    return true;
 }
 
-void plant_routine(pos_t pos) {
-    entity_t& plant = entity_grid[pos.i][pos.j];
-    int my_it = current_it;
+// Default time /next-iteration waits for a tick before answering 503
+const uint32_t DEFAULT_TICK_TIMEOUT_MS = 5000;
 
-    while(true) {
+// Most ticks a single /next-iteration can ask for
+const uint32_t MAX_STEPS = 1000000;
 
-        std::unique_lock lk(exec_it_mtx);
-        while(!new_it(my_it)) exec_it.wait(lk);
-        my_it ++;
+// Every this many ticks /ws viewers get a keyframe instead of a delta
+const uint32_t KEYFRAME_INTERVAL = 100;
 
-        if(plant.type == empty or plant.age == PLANT_MAXIMUM_AGE) {
-            thread_counter --;
-            entity_grid[pos.i][pos.j] = {empty, 0, 0};
-            return;
-        }
+// Default time a session can go without requests nor viewers before it is evicted
+const uint32_t DEFAULT_SESSION_IDLE_S = 600;
 
-        std::vector<pos_t> empty_pos;
-        for(const pos_t& pos_to_verify : {pos_t(pos.i, pos.j+1), pos_t(pos.i,pos.j-1), pos_t(pos.i+1,pos.j), pos_t(pos.i-1,pos.j)}) {
+// Default memory a session can take for its grid, enough for the largest one
+const uint32_t DEFAULT_SESSION_MEMORY_MB = 512;
 
-            if(!(pos_to_verify.i >= 0 and pos_to_verify.i < NUM_ROWS and pos_to_verify.j >= 0 and pos_to_verify.j < NUM_ROWS)) {
-				continue;
-            }
-            
-            if(entity_grid[pos_to_verify.i][pos_to_verify.j].type == empty)
-                empty_pos.push_back(pos_to_verify);
-        }
+// Default number of sessions the server keeps at once
+const uint32_t DEFAULT_MAX_SESSIONS = 64;
 
+// What /metrics reports about a session. A copy is published after every
+// tick and start, so that /metrics never waits for a tick in progress.
+struct status_t
+{
+    uint32_t run = 0;
+    uint32_t tick = 0;
+    uint64_t seed = 0;
+    size_t memory_bytes = 0;
+    nlohmann::json parameters;
+    population_stats_t stats;
+    tick_metrics_t metrics;
+    std::vector<uint64_t> tile_ns;
+    uint32_t tiles_down = 0;
+    uint32_t tiles_across = 0;
+};
 
-        if(mp_rand(gen) < PLANT_REPRODUCTION_PROBABILITY and !empty_pos.empty()) {
+// An independent run of the simulation, created by /start-simulation and
+// addressed by its id. Sessions share the worker pool, which runs their ticks
+// in turns (see worker_pool_t); each one has its own ticker, viewers and status.
+//
+// Only the ticker thread of the session touches its simulation: it runs the
+// ticks, and requests that restart or read the run are queued to it (see
+// respond()), so no request thread ever waits for a tick or for the pool.
+struct session_t : std::enable_shared_from_this<session_t>
+{
+    // /ws viewers, with the io_service of the thread of their connection
+    using viewer_set_t = std::unordered_map<crow::websocket::connection *, boost::asio::io_service *>;
+
+    session_t(worker_pool_t &pool, std::chrono::milliseconds tick_timeout);
+
+    // Copies the state reported by /metrics; called on the ticker thread with
+    // no tick in progress, unless `tick_done` is false
+    void publish_status(bool tick_done);
+
+    // Runs a tick and pushes the new frame to the viewers. A tick that times
+    // out keeps running on the pool and the next one waits for it; the ticker
+    // is asked to publish its status as soon as it completes (see settle()).
+    // Returns whether the tick completed in time.
+    bool run_tick();
+
+    // Waits for a tick that timed out and publishes its status, so that the
+    // simulation can be read or ticked
+    void settle();
+
+    // Sends a keyframe to the viewers that just subscribed, which then get a frame per tick
+    void welcome_viewers();
+
+    // Subscribes `conn` to the frames of the session, starting with a keyframe sent by the ticker
+    void subscribe(crow::websocket::connection &conn);
+    void unsubscribe(crow::websocket::connection &conn);
+
+    // Sends `frame` to the viewers in `to`, each on the thread of its connection.
+    // A connection is only used there, and only while it is still subscribed:
+    // onclose runs on that thread too and unsubscribes it before it is destroyed.
+    void send_frame(const viewer_set_t &to, std::string frame);
+
+    // Queues `steps` ticks (0 for none) to the ticker, then `write` on the
+    // ticker thread with no tick in progress, and sends the response it wrote
+    // on the thread of the connection of `req`. If a tick times out or the
+    // session is evicted first, the client gets a 503 instead, and a 500 if
+    // a tick or `write` throws. `write` must not use `req`, which may be gone.
+    void respond(const crow::request &req, crow::response &res, uint32_t steps, std::function<void(crow::response &)> write);
+
+    simulation_t simulation;
+    std::chrono::milliseconds tick_timeout;
+
+    // Viewers subscribed to /ws, the ones still waiting for their first
+    // keyframe, and the frame they were last sent. The sets are guarded by
+    // viewers_mtx, the frame is only used by the ticker thread. Frames are
+    // encoded and sent outside of the lock, on copies of the sets.
+    viewer_set_t viewers;
+    viewer_set_t new_viewers;
+    std::mutex viewers_mtx;
+    // Size of both sets, read without the lock by /metrics and the eviction of idle sessions
+    std::atomic<size_t> num_viewers{0};
+    uint32_t broadcast_run = 0;
+    uint32_t broadcast_tick = 0;
+    // Whether a tick timed out and its status is not published yet, used by the ticker thread
+    bool late_tick = false;
+
+    status_t status;
+    std::mutex status_mtx;
+
+    // Last time a request addressed the session
+    std::atomic<std::chrono::steady_clock::time_point> last_used;
+
+    // Runs the ticks requested by /next-iteration and the ones at the rate set
+    // by /start-simulation and the viewers. Declared last, its thread uses the
+    // members above.
+    ticker_t ticker;
+};
 
-            size_t idx = mp_rand(gen) * empty_pos.size();
-            std::vector<pos_t>::iterator idx_it = empty_pos.begin() + idx;
+session_t::session_t(worker_pool_t &pool, std::chrono::milliseconds tick_timeout)
+    : simulation(pool), tick_timeout(tick_timeout), last_used(std::chrono::steady_clock::now()), ticker([this]
+                                                                                                        { return run_tick(); })
+{
+}
 
-            pos_t child_pos = empty_pos[idx];
+void session_t::publish_status(bool tick_done)
+{
+    std::lock_guard lk(status_mtx);
+    status.metrics = simulation.metrics();
+    if (!tick_done)
+        return;
 
-            entity_grid[child_pos.i][child_pos.j] = {entity_type_t::plant, 0, 0};
-            std::thread t(plant_routine, child_pos);
-            t.detach();
-            thread_counter ++;
-        }
-        
-        plant.age ++;
-        completion_counter ++;
+    if (status.run != simulation.current_run())
+    {
+        status.run = simulation.current_run();
+        status.seed = simulation.current_seed();
+        status.memory_bytes = simulation.memory_used();
+        status.parameters = params_to_json(simulation.current_params());
     }
+    status.tick = simulation.current_tick();
+    status.stats = simulation.stats();
+    status.tile_ns = simulation.tile_times_ns();
+    status.tiles_down = simulation.tiles_down();
+    status.tiles_across = simulation.tiles_across();
 }
 
-void herbi_routine(pos_t pos) {
-    pos_t& cur_pos = pos;
-    entity_t herbi ;
-    int my_it = current_it;
-    while(true) {
-        herbi = entity_grid[cur_pos.i][cur_pos.j];
-        std::unique_lock lk(exec_it_mtx);
-        while(!new_it(my_it)) exec_it.wait(lk);
-        my_it ++;
-        if(herbi.type == empty or herbi.energy == 0 or herbi.age == HERBIVORE_MAXIMUM_AGE) {
-            thread_counter --;
-            entity_grid[cur_pos.i][cur_pos.j] = {empty, 0, 0};
-            return;
-        }
+bool session_t::run_tick()
+{
+    settle();
+    simulation.begin_step();
+    bool done = simulation.wait_step(tick_timeout);
+    publish_status(done);
+    if (!done) {
+        late_tick = true;
+        ticker.request_steps(0, [this](ticker_t::steps_result_t steps_result)
+                             {
+            if (steps_result == ticker_t::steps_result_t::done)
+                settle(); });
+        return false;
+    }
 
-        std::vector<pos_t> empty_pos;
-        for(const pos_t& pos_to_verify : {pos_t(cur_pos.i, cur_pos.j+1), pos_t(cur_pos.i,cur_pos.j-1), pos_t(cur_pos.i+1,cur_pos.j), pos_t(cur_pos.i-1,cur_pos.j)}) {
+    viewer_set_t to;
+    {
+        std::lock_guard viewers_lk(viewers_mtx);
+        if (viewers.empty())
+            return true;
+        to = viewers;
+    }
 
-            if(!(pos_to_verify.i >= 0 and pos_to_verify.i < NUM_ROWS and pos_to_verify.j >= 0 and pos_to_verify.j < NUM_ROWS)) {
-				continue;
-            }
+    bool keyframe = broadcast_run != simulation.current_run() or simulation.current_tick() % KEYFRAME_INTERVAL == 0;
+    std::string frame = keyframe ? encode_keyframe(simulation) : encode_delta(simulation, broadcast_tick);
+    broadcast_run = simulation.current_run();
+    broadcast_tick = simulation.current_tick();
 
-            if(entity_grid[pos_to_verify.i][pos_to_verify.j].type == plant and mp_rand(gen) < HERBIVORE_EAT_PROBABILITY) {
-                entity_grid[pos_to_verify.i][pos_to_verify.j] = {empty, 0, 0};
-                herbi.energy += HERBIVORE_ENERGY_GAIN;
-            }
-            
-            if(entity_grid[pos_to_verify.i][pos_to_verify.j].type == empty)
-                empty_pos.push_back(pos_to_verify);
-        }
+    send_frame(to, std::move(frame));
+    return true;
+}
 
-        if(mp_rand(gen) < HERBIVORE_REPRODUCTION_PROBABILITY and herbi.energy > THRESHOLD_ENERGY_FOR_REPRODUCTION and !empty_pos.empty()) {
+void session_t::settle()
+{
+    simulation.wait_idle();
+    if (!late_tick)
+        return;
 
-            size_t idx = mp_rand(gen) * empty_pos.size();
-            std::vector<pos_t>::iterator idx_it = empty_pos.begin() + idx;
+    publish_status(true);
+    late_tick = false;
+}
 
-            pos_t child_pos = empty_pos[idx];
+void session_t::welcome_viewers()
+{
+    // A tick that timed out may still be running
+    settle();
 
-            entity_grid[child_pos.i][child_pos.j] = {entity_type_t::herbivore, START_ENERGY, 0};
-            std::thread t(herbi_routine, child_pos);
-            t.detach();
-            thread_counter ++;
+    viewer_set_t welcomed;
+    {
+        std::lock_guard viewers_lk(viewers_mtx);
+        if (new_viewers.empty())
+            return;
+        welcomed = new_viewers;
+    }
+    send_frame(welcomed, encode_keyframe(simulation));
 
-            empty_pos.erase(idx_it);
+    // Viewers that left in the meantime are not in new_viewers any more
+    std::lock_guard viewers_lk(viewers_mtx);
+    for (auto [viewer, io_service] : welcomed)
+        if (new_viewers.erase(viewer))
+            viewers.emplace(viewer, io_service);
+}
 
-            herbi.energy -= REPRODUCTION_ENERGY;
-        }
+void session_t::subscribe(crow::websocket::connection &conn)
+{
+    {
+        std::lock_guard viewers_lk(viewers_mtx);
+        new_viewers.emplace(&conn, &conn.get_io_service());
+        num_viewers = viewers.size() + new_viewers.size();
+    }
+    ticker.request_steps(0, [this](ticker_t::steps_result_t steps_result)
+                         {
+        if (steps_result == ticker_t::steps_result_t::done)
+            welcome_viewers(); });
+}
 
-        if(mp_rand(gen) < HERBIVORE_MOVE_PROBABILITY and !empty_pos.empty()) {
+void session_t::unsubscribe(crow::websocket::connection &conn)
+{
+    std::lock_guard viewers_lk(viewers_mtx);
+    viewers.erase(&conn);
+    new_viewers.erase(&conn);
+    num_viewers = viewers.size() + new_viewers.size();
+}
 
-            size_t idx = mp_rand(gen) * empty_pos.size();
-            entity_grid[cur_pos.i][cur_pos.j] = {empty, 0, 0};
-            cur_pos = empty_pos[idx];
-            herbi.energy -= MOVE_ENERGY;
-            entity_grid[cur_pos.i][cur_pos.j] = {herbi.type, herbi.energy, herbi.age++};
-            herbi = entity_grid[cur_pos.i][cur_pos.j];
+void session_t::send_frame(const viewer_set_t &to, std::string frame)
+{
+    // The frame is shared by the viewers, and the session may be gone by the time it is sent
+    auto shared_frame = std::make_shared<const std::string>(std::move(frame));
+    std::weak_ptr<session_t> weak_session = weak_from_this();
+    for (auto [viewer, io_service] : to)
+        io_service->post([weak_session, viewer = viewer, shared_frame]
+                         {
+            std::shared_ptr<session_t> session = weak_session.lock();
+            if (!session)
+                return;
+
+            std::lock_guard viewers_lk(session->viewers_mtx);
+            if (session->viewers.count(viewer) or session->new_viewers.count(viewer))
+                viewer->send_binary(*shared_frame); });
+}
+
+void session_t::respond(const crow::request &req, crow::response &res, uint32_t steps, std::function<void(crow::response &)> write)
+{
+    // The callback runs on the thread of the ticker, which the session outlives.
+    // The connection keeps `res` until it is completed, but not `req`.
+    boost::asio::io_service *io_service = req.io_service;
+    ticker.request_steps(steps, [this, io_service, &res, write = std::move(write)](ticker_t::steps_result_t steps_result)
+                         {
+        auto result = std::make_shared<crow::response>();
+        if (steps_result == ticker_t::steps_result_t::timed_out) {
+            result->code = 503;
+            result->body = "Tick timed out";
+        } else if (steps_result == ticker_t::steps_result_t::stopped) {
+            result->code = 503;
+            result->body = "Session evicted";
+        } else if (steps_result == ticker_t::steps_result_t::failed) {
+            result->code = 500;
+            result->body = "Tick failed";
+        } else {
+            try {
+                settle();
+                write(*result);
+            } catch (const std::exception &e) {
+                std::fprintf(stderr, "response failed: %s\n", e.what());
+                result = std::make_shared<crow::response>(500, "Response failed");
+            }
         }
 
-       entity_grid[cur_pos.i][cur_pos.j].age++;
-       completion_counter ++;
-    }
-    
+        io_service->post([&res, result]
+                             {
+            res.code = result->code;
+            res.body = std::move(result->body);
+            res.headers = std::move(result->headers);
+            res.end(); }); });
 }
 
-void carni_routine(pos_t pos) {
-    pos_t& cur_pos = pos;
-    entity_t carni;
-    int my_it = current_it;
-
-    while(true) {
-        carni = entity_grid[cur_pos.i][cur_pos.j];
-        std::unique_lock lk(exec_it_mtx);
-        while(!new_it(my_it)) exec_it.wait(lk);
-        my_it ++;
-        if(carni.type == empty or carni.energy == 0 or carni.age == CARNIVORE_MAXIMUM_AGE) {
-            thread_counter --;
-            entity_grid[cur_pos.i][cur_pos.j] = {empty, 0, 0};
-            return;
-        }
+// Sessions by id
+class session_registry_t
+{
+public:
+    session_registry_t(worker_pool_t &pool, std::chrono::milliseconds tick_timeout, size_t max_sessions)
+        : pool(pool), tick_timeout(tick_timeout), max_sessions(max_sessions) {}
 
-        std::vector<pos_t> empty_pos;
-        for(const pos_t& pos_to_verify : {pos_t(cur_pos.i, cur_pos.j+1), pos_t(cur_pos.i,cur_pos.j-1), pos_t(cur_pos.i+1,cur_pos.j), pos_t(cur_pos.i-1,cur_pos.j)}) {
+    // Creates a session and returns its id, or leaves `session` empty if there
+    // are already `max_sessions`
+    std::string create(std::shared_ptr<session_t> &session)
+    {
+        // Ids are random so that clients cannot guess the sessions of others
+        std::random_device random;
+        char id[17];
+        std::snprintf(id, sizeof(id), "%08x%08x", random(), random());
+
+        std::lock_guard lk(mtx);
+        if (sessions.size() >= max_sessions)
+            return {};
+
+        session = std::make_shared<session_t>(pool, tick_timeout);
+        sessions[id] = session;
+        return id;
+    }
 
-            if(!(pos_to_verify.i >= 0 and pos_to_verify.i < NUM_ROWS and pos_to_verify.j >= 0 and pos_to_verify.j < NUM_ROWS)) {
-				continue;
-            }
+    // Session with the id, nullptr if there is none. Counts as a use of the session.
+    std::shared_ptr<session_t> find(const char *id)
+    {
+        if (!id)
+            return nullptr;
 
-            if(entity_grid[pos_to_verify.i][pos_to_verify.j].type == herbivore and mp_rand(gen) < CARNIVORE_EAT_PROBABILITY) {
-                entity_grid[pos_to_verify.i][pos_to_verify.j] = {empty, 0, 0};
-                carni.energy += CARNIVORE_ENERGY_GAIN;
-            }
-            
-            if(entity_grid[pos_to_verify.i][pos_to_verify.j].type == empty)
-                empty_pos.push_back(pos_to_verify);
-        }
+        std::lock_guard lk(mtx);
+        auto it = sessions.find(id);
+        if (it == sessions.end())
+            return nullptr;
 
-        if(mp_rand(gen) < CARNIVORE_REPRODUCTION_PROBABILITY and carni.energy > THRESHOLD_ENERGY_FOR_REPRODUCTION and !empty_pos.empty()) {
-            size_t idx = mp_rand(gen) * empty_pos.size();
-            std::vector<pos_t>::iterator idx_it = empty_pos.begin() + idx;
+        it->second->last_used = std::chrono::steady_clock::now();
+        return it->second;
+    }
 
-            pos_t child_pos = empty_pos[idx];
+    // Drops the session with the id, if any
+    void remove(const std::string &id)
+    {
+        std::shared_ptr<session_t> removed;
+        std::lock_guard lk(mtx);
+        auto it = sessions.find(id);
+        if (it == sessions.end())
+            return;
 
-            entity_grid[child_pos.i][child_pos.j] = {entity_type_t::carnivore, START_ENERGY, 0};
-            std::thread t(carni_routine, child_pos);
-            t.detach();
-            thread_counter ++;
+        // Destroyed after the lock is released, as it waits for its ticks
+        removed = std::move(it->second);
+        sessions.erase(it);
+    }
 
-            empty_pos.erase(idx_it);
+    size_t size()
+    {
+        std::lock_guard lk(mtx);
+        return sessions.size();
+    }
 
-            carni.energy -= REPRODUCTION_ENERGY;
+    // Drops the sessions that were not used for `max_idle` and have neither
+    // viewers nor steps to run, even if they run ticks at a rate. Requests
+    // still holding one keep it alive until they are done.
+    void evict_idle(std::chrono::steady_clock::duration max_idle)
+    {
+        std::vector<std::shared_ptr<session_t>> evicted;
+        {
+            std::lock_guard lk(mtx);
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = sessions.begin(); it != sessions.end();)
+            {
+                std::shared_ptr<session_t> &session = it->second;
+                if (session->num_viewers == 0 and now - session->last_used.load() > max_idle and !session->ticker.busy())
+                {
+                    evicted.push_back(std::move(session));
+                    it = sessions.erase(it);
+                }
+                else
+                    ++it;
+            }
         }
+        // Destroyed here, outside of the lock, as they wait for their ticks
+    }
 
-        if(mp_rand(gen) < CARNIVORE_MOVE_PROBABILITY and !empty_pos.empty()) {
+private:
+    worker_pool_t &pool;
+    std::chrono::milliseconds tick_timeout;
+    size_t max_sessions;
 
-            size_t idx = mp_rand(gen) * empty_pos.size();
+    std::mutex mtx;
+    std::unordered_map<std::string, std::shared_ptr<session_t>> sessions;
+};
 
-            entity_grid[cur_pos.i][cur_pos.j] = {empty, 0, 0};
-            cur_pos = empty_pos[idx];
-            carni.energy -= MOVE_ENERGY;
-            entity_grid[cur_pos.i][cur_pos.j] = {carni.type, carni.energy, carni.age++};
-            carni = entity_grid[cur_pos.i][cur_pos.j];
-        }
+int main(int argc, char *argv[])
+{
+    crow::SimpleApp app;
 
-        entity_grid[cur_pos.i][cur_pos.j].age++;
-        completion_counter ++;
+    // Command line options
+    uint32_t tick_timeout_ms = DEFAULT_TICK_TIMEOUT_MS;
+    uint32_t session_idle_s = DEFAULT_SESSION_IDLE_S;
+    uint32_t session_memory_mb = DEFAULT_SESSION_MEMORY_MB;
+    uint32_t max_sessions = DEFAULT_MAX_SESSIONS;
+    size_t num_workers = std::thread::hardware_concurrency();
+    uint16_t http_threads = std::thread::hardware_concurrency();
+    for (int idx = 1; idx < argc; idx++)
+    {
+        if (std::strcmp(argv[idx], "--tick-timeout-ms") == 0 and idx + 1 < argc)
+            tick_timeout_ms = std::stoul(argv[++idx]);
+        else if (std::strcmp(argv[idx], "--workers") == 0 and idx + 1 < argc)
+            num_workers = std::stoul(argv[++idx]);
+        else if (std::strcmp(argv[idx], "--http-threads") == 0 and idx + 1 < argc)
+            http_threads = std::stoul(argv[++idx]);
+        else if (std::strcmp(argv[idx], "--session-idle-s") == 0 and idx + 1 < argc)
+            session_idle_s = std::stoul(argv[++idx]);
+        else if (std::strcmp(argv[idx], "--session-memory-mb") == 0 and idx + 1 < argc)
+            session_memory_mb = std::stoul(argv[++idx]);
+        else if (std::strcmp(argv[idx], "--max-sessions") == 0 and idx + 1 < argc)
+            max_sessions = std::stoul(argv[++idx]);
     }
 
-}
+    // Fixed pool of workers shared by the ticks of every session, sized to the number of cores by default
+    worker_pool_t pool(num_workers);
+    session_registry_t sessions(pool, std::chrono::milliseconds(tick_timeout_ms), max_sessions);
 
-int main()
-{
-    crow::SimpleApp app;
+    // Session every /ws viewer subscribed to, which it keeps alive
+    std::unordered_map<crow::websocket::connection *, std::shared_ptr<session_t>> viewer_sessions;
+    std::mutex viewer_sessions_mtx;
+
+    // Checks for idle sessions once per second
+    ticker_t evictor([&]
+                     {
+        sessions.evict_idle(std::chrono::seconds(session_idle_s));
+        return true; });
+    evictor.set_rate(1);
 
     // Endpoint to serve the HTML page
     CROW_ROUTE(app, "/")
@@ -280,8 +544,12 @@ int main()
         res.set_static_file_info_unsafe("../public/index.html");
         res.end(); });
 
+    // Starts a run in a new session, whose id is returned in the Session-Id
+    // header, or restarts the session given by `?session=`. With `?grid=false`
+    // only the statistics of the initial population are returned, which
+    // clients that get their frames from /ws use to skip a large initial grid.
     CROW_ROUTE(app, "/start-simulation")
-        .methods("POST"_method)([](crow::request &req, crow::response &res)
+        .methods("POST"_method)([&](crow::request &req, crow::response &res)
                                 { 
         // Parse the JSON request body
         nlohmann::json request_body = nlohmann::json::parse(req.body);
@@ -290,73 +558,336 @@ int main()
         uint32_t num_plant = request_body["plants"],
                  num_herbi = request_body["herbivores"],
                  num_carni = request_body["carnivores"];
+        uint32_t width = request_body.value("width", DEFAULT_GRID_SIZE),
+                 height = request_body.value("height", DEFAULT_GRID_SIZE);
+
+        // Runs without a seed get a random one, reported by /metrics so they can be replayed
+        uint64_t seed = request_body.contains("seed") ? request_body["seed"].get<uint64_t>()
+                                                      : (uint64_t(std::random_device{}()) << 32) | std::random_device{}();
 
-        uint32_t total_entinties = num_plant + num_herbi + num_carni;
-        if (total_entinties > NUM_ROWS * NUM_ROWS) {
+        if (width == 0 or height == 0 or width > MAX_GRID_SIZE or height > MAX_GRID_SIZE) {
+        res.code = 400;
+        res.body = "Invalid grid size";
+        res.end();
+        return;
+        }
+
+        // The memory of the grid is taken up front, so it is checked before anything is allocated
+        size_t memory_needed = simulation_t::memory_needed(width, height);
+        if (memory_needed > size_t(session_memory_mb) << 20) {
+        res.code = 413;
+        res.body = "Grid needs " + std::to_string((memory_needed + (1 << 20) - 1) >> 20) + " MB, over the limit of " +
+                   std::to_string(session_memory_mb) + " MB per session";
+        res.end();
+        return;
+        }
+
+        uint64_t total_entinties = uint64_t(num_plant) + num_herbi + num_carni;
+        if (total_entinties > uint64_t(width) * height) {
         res.code = 400;
         res.body = "Too many entities";
         res.end();
         return;
         }
 
-        // Clear the entity grid
-        entity_grid.clear();
-        entity_grid.assign(NUM_ROWS, std::vector<entity_t>(NUM_ROWS, { empty, 0, 0}));
-        
-        // Create the entities
-        pos_t creation_pos;
-        thread_counter = 0;
-        completion_counter = 0;
-        current_it = 0;
-
-        for(size_t idx = 0; idx != num_plant; idx ++) {
-            creation_pos.i = rand_pos(gen);
-            creation_pos.j = rand_pos(gen);
-            entity_grid[creation_pos.i][creation_pos.j] = {plant, START_ENERGY, 0};
-            std::thread t(plant_routine, creation_pos);
-            t.detach();
-            thread_counter ++;
+        // Optional overrides of the species parameters, reported by /metrics
+        simulation_params_t params;
+        std::string params_error;
+        if (request_body.contains("parameters") and !params_from_json(request_body["parameters"], params, params_error)) {
+        res.code = 400;
+        res.body = params_error;
+        res.end();
+        return;
         }
 
-        for(size_t idx = 0; idx != num_herbi; idx ++) {
-            creation_pos.i = rand_pos(gen);
-            creation_pos.j = rand_pos(gen);
-            entity_grid[creation_pos.i][creation_pos.j] = {herbivore, START_ENERGY, 0};
-            std::thread t(herbi_routine, creation_pos);
-            t.detach();
-            thread_counter ++;
+        // Optional free-running mode: the server advances the run on its own
+        // and /next-iteration only reads the latest completed tick
+        double tick_rate = 0;
+        bool has_tick_rate = request_body.contains("ticks_per_second");
+        if (has_tick_rate and !parse_rate(request_body["ticks_per_second"], tick_rate)) {
+        res.code = 400;
+        res.body = "Invalid ticks_per_second";
+        res.end();
+        return;
         }
 
-        for(size_t idx = 0; idx != num_carni; idx ++) {
-            creation_pos.i = rand_pos(gen);
-            creation_pos.j = rand_pos(gen);
-            entity_grid[creation_pos.i][creation_pos.j] = {carnivore, 100, 0};
-            std::thread t(carni_routine, creation_pos);
-            t.detach();
-            thread_counter ++;
+        std::shared_ptr<session_t> session;
+        std::string session_id;
+        bool restart = req.url_params.get("session") != nullptr;
+        if (restart) {
+        session = sessions.find(req.url_params.get("session"));
+        session_id = req.url_params.get("session");
+        } else {
+        session_id = sessions.create(session);
+        if (!session) {
+        res.code = 503;
+        res.body = "Too many sessions";
+        res.end();
+        return;
+        }
         }
 
-        // Return the JSON representation of the entity grid
-        nlohmann::json json_grid = entity_grid; 
-        res.body = json_grid.dump();
-        res.end(); });
+        if (!session) {
+        res.code = 404;
+        res.body = "Unknown session";
+        res.end();
+        return;
+        }
 
-    // Endpoint to process HTTP GET requests for the next simulation iteration
+        // The run is restarted on the ticker thread, after the ticks already queued
+        session_t &started = *session;
+        grid_format_t format(req);
+        boost::asio::io_service *io_service = req.io_service;
+        session->respond(req, res, 0, [&sessions, &started, format, io_service, restart, session_id, width, height, num_plant, num_herbi, num_carni, seed, params, has_tick_rate, tick_rate](crow::response &out)
+                         {
+            try {
+                started.simulation.start(width, height, num_plant, num_herbi, num_carni, seed, params);
+            } catch (const std::bad_alloc &) {
+                // A restarted session keeps its current run, a new one is dropped.
+                // It is destroyed on the thread of the connection, as it joins this one.
+                if (!restart)
+                    io_service->post([&sessions, session_id]
+                                         { sessions.remove(session_id); });
+                out.code = 503;
+                out.body = "Not enough memory for the grid";
+                return;
+            }
+            started.publish_status(true);
+            if (has_tick_rate)
+                started.ticker.set_rate(tick_rate);
+
+            // Return the representation of the entity grid
+            out.set_header("Session-Id", session_id);
+            if (format.grid)
+                write_grid(format, out, started.simulation);
+            else
+                out.body = stats_to_json(started.simulation.current_tick(), started.simulation.stats()).dump(); }); });
+
+    // Endpoint to process HTTP GET requests for the next simulation iteration of `?session=`,
+    // or for the iteration `?steps=` ticks ahead. With `?grid=false` only the tick and
+    // the statistics of the population (see /stats) are returned.
     CROW_ROUTE(app, "/next-iteration")
+        .methods("GET"_method)([&](const crow::request &req, crow::response &res)
+                               {
+        std::shared_ptr<session_t> session = sessions.find(req.url_params.get("session"));
+        if (!session) {
+        res.code = 404;
+        res.body = "Unknown session";
+        res.end();
+        return;
+        }
+
+        const char *steps_param = req.url_params.get("steps");
+        unsigned long steps = steps_param ? std::strtoul(steps_param, nullptr, 10) : 1;
+        if (steps == 0 or steps > MAX_STEPS) {
+        res.code = 400;
+        res.body = "Invalid steps";
+        res.end();
+        return;
+        }
+
+        // A session that runs ticks on its own just reports the latest one,
+        // unless the client asked for a number of steps
+        if (session->ticker.rate() > 0 and !steps_param)
+            steps = 0;
+
+        // The ticker thread of the session runs the ticks back to back, without
+        // serializing the ones in between. The handler returns right away and the
+        // response is completed on the thread of the connection once they are done.
+        session_t &ticked = *session;
+        ticked.respond(req, res, steps, [&ticked, format = grid_format_t(req)](crow::response &out)
+                       {
+            if (format.grid)
+                write_grid(format, out, ticked.simulation);
+            else
+                out.body = stats_to_json(ticked.simulation.current_tick(), ticked.simulation.stats()).dump(); }); });
+
+    // Latest completed tick of `?session=`, without advancing the simulation
+    CROW_ROUTE(app, "/snapshot")
+        .methods("GET"_method)([&](const crow::request &req, crow::response &res)
+                               {
+        std::shared_ptr<session_t> session = sessions.find(req.url_params.get("session"));
+        if (!session) {
+        res.code = 404;
+        res.body = "Unknown session";
+        res.end();
+        return;
+        }
+
+        // Read between two ticks, on the ticker thread
+        session_t &read = *session;
+        read.respond(req, res, 0, [&read, format = grid_format_t(req)](crow::response &out)
+                     { write_grid(format, out, read.simulation); }); });
+
+    // Push channel: viewers subscribe to a session with {"session": id}, receive
+    // a keyframe and then one frame per tick. Any viewer can set the tick rate of
+    // its session with {"rate": ticks_per_second} (see parse_rate()).
+    CROW_ROUTE(app, "/ws")
+        .websocket()
+        .onclose([&](crow::websocket::connection &conn, const std::string &)
+                 {
+        // The lock only guards the map: the last viewer of an evicted session waits for its ticks
+        std::shared_ptr<session_t> released;
+        {
+            std::lock_guard lk(viewer_sessions_mtx);
+            auto it = viewer_sessions.find(&conn);
+            if (it == viewer_sessions.end())
+                return;
+            released = std::move(it->second);
+            viewer_sessions.erase(it);
+        }
+        if (released)
+            released->unsubscribe(conn); })
+        .onmessage([&](crow::websocket::connection &conn, const std::string &data, bool is_binary)
+                   {
+        nlohmann::json message = nlohmann::json::parse(data, nullptr, false);
+        if (is_binary or !message.is_object())
+            return;
+
+        // Handlers of a connection run on its thread one at a time: the lock
+        // only guards the map, against the handlers of the other connections
+        bool subscribing = message.contains("session") and message["session"].is_string();
+        std::shared_ptr<session_t> session, released;
+        if (subscribing) {
+            session = sessions.find(message["session"].get<std::string>().c_str());
+            if (!session) {
+                conn.send_text("Unknown session");
+                return;
+            }
+        }
+        {
+            std::lock_guard lk(viewer_sessions_mtx);
+            std::shared_ptr<session_t> &subscribed = viewer_sessions[&conn];
+            if (subscribing)
+                released = std::exchange(subscribed, session);
+            else
+                session = subscribed;
+        }
+
+        // A viewer that leaves before its keyframe is unsubscribed by onclose
+        if (subscribing) {
+            if (released)
+                released->unsubscribe(conn);
+            session->subscribe(conn);
+        }
+
+        double tick_rate;
+        if (session and message.contains("rate") and parse_rate(message["rate"], tick_rate))
+            session->ticker.set_rate(tick_rate); });
+
+    // Species of the simulation, indexed by their type in the binary frames,
+    // with the symbol that stands for them in the JSON grids
+    CROW_ROUTE(app, "/species")
         .methods("GET"_method)([]()
                                {
-        // Simulate the next iteration
-        // Iterate over the entity grid and simulate the behaviour of each entity
-        
-        current_it ++;
-        completion_counter = 0;
-        exec_it.notify_all();
-        while(completion_counter < thread_counter);
-        
-        // Return the JSON representation of the entity grid
-        nlohmann::json json_grid = entity_grid; 
-        return json_grid.dump(); });
-    app.port(8080).run();
+        nlohmann::json json_species = nlohmann::json::array();
+        for_each_species([&](auto traits)
+                         { json_species.push_back({{"type", traits.type}, {"name", traits.name}, {"symbol", std::string(1, traits.symbol)},
+                                                   {"needs_energy", traits.needs_energy}}); });
+        return crow::response(json_species.dump()); });
+
+    // Population statistics of `?session=` as of its last completed tick: count, mean,
+    // min and max energy and age of every species, and its births, deaths of old age
+    // or starvation and deaths by predation during that tick
+    CROW_ROUTE(app, "/stats")
+        .methods("GET"_method)([&](const crow::request &req)
+                               {
+        std::shared_ptr<session_t> session = sessions.find(req.url_params.get("session"));
+        if (!session)
+            return crow::response(404, "Unknown session");
+
+        std::lock_guard lk(session->status_mtx);
+        return crow::response(stats_to_json(session->status.tick, session->status.stats).dump()); });
+
+    // Endpoint with the timing metrics of the tick engine and, given `?session=`,
+    // of a session as of its last completed tick
+    CROW_ROUTE(app, "/metrics")
+        .methods("GET"_method)([&](const crow::request &req)
+                               {
+        nlohmann::json json_metrics = {
+            {"workers", pool.size()},
+            {"sessions", sessions.size()},
+        };
+
+        // Work stealing: time every worker spent running tasks and how often it stole work
+        nlohmann::json worker_busy_us = nlohmann::json::array(), worker_steals = nlohmann::json::array();
+        for (const worker_pool_t::worker_stats_t &stats : pool.stats()) {
+            worker_busy_us.push_back(stats.busy_ns / 1000);
+            worker_steals.push_back(stats.steals);
+        }
+        json_metrics["worker_busy_us"] = std::move(worker_busy_us);
+        json_metrics["worker_steals"] = std::move(worker_steals);
+
+        if (!req.url_params.get("session"))
+            return crow::response(json_metrics.dump());
+
+        std::shared_ptr<session_t> session = sessions.find(req.url_params.get("session"));
+        if (!session)
+            return crow::response(404, "Unknown session");
+
+        size_t num_viewers = session->num_viewers;
+        double tick_rate = session->ticker.rate();
+
+        std::lock_guard lk(session->status_mtx);
+        const status_t &status = session->status;
+        const tick_metrics_t &metrics = status.metrics;
+
+        json_metrics.update({
+            {"session", req.url_params.get("session")},
+            {"tick", status.tick},
+            {"seed", status.seed},
+            {"memory_bytes", status.memory_bytes},
+            {"parameters", status.parameters},
+            {"tick_rate", tick_rate == ticker_t::UNLIMITED_RATE ? nlohmann::json("max") : nlohmann::json(tick_rate)},
+            {"viewers", num_viewers},
+            {"ticks", metrics.ticks},
+            {"tick_timeouts", metrics.timeouts},
+            {"last_tick_wait_us", metrics.last_wait_us},
+            {"max_tick_wait_us", metrics.max_wait_us},
+            {"total_tick_wait_us", metrics.total_wait_us},
+            {"last_tick_allocations", metrics.last_tick_allocations},
+        });
+
+        // Load balance of the last tick: time of the slowest and of the average tile
+        uint64_t total_tile_ns = 0, max_tile_ns = 0;
+        for (uint64_t ns : status.tile_ns) {
+            total_tile_ns += ns;
+            max_tile_ns = std::max(max_tile_ns, ns);
+        }
+        json_metrics["tiles"] = status.tile_ns.size();
+        json_metrics["max_tile_us"] = max_tile_ns / 1000.0;
+        json_metrics["mean_tile_us"] = status.tile_ns.empty() ? 0.0 : total_tile_ns / 1000.0 / status.tile_ns.size();
+        return crow::response(json_metrics.dump()); });
+
+    // Time spent in every tile of `?session=` during its last tick, in microseconds, as rows of tiles
+    CROW_ROUTE(app, "/metrics/tiles")
+        .methods("GET"_method)([&](const crow::request &req)
+                               {
+        std::shared_ptr<session_t> session = sessions.find(req.url_params.get("session"));
+        if (!session)
+            return crow::response(404, "Unknown session");
+
+        std::lock_guard lk(session->status_mtx);
+        const status_t &status = session->status;
+
+        nlohmann::json json_tiles = nlohmann::json::array();
+        for (uint32_t row = 0; row != status.tiles_down; row++) {
+            nlohmann::json json_row = nlohmann::json::array();
+            for (uint32_t col = 0; col != status.tiles_across; col++)
+                json_row.push_back(status.tile_ns[size_t(row) * status.tiles_across + col] / 1000.0);
+            json_tiles.push_back(std::move(json_row));
+        }
+
+        nlohmann::json json_metrics = {
+            {"tick", status.tick},
+            {"tile_rows", TILE_ROWS},
+            {"tile_cols", TILE_COLS},
+            {"tile_us", std::move(json_tiles)},
+        };
+        return crow::response(json_metrics.dump()); });
+
+    // Requests are served by several threads, and none of them waits for ticks
+    app.port(8080).concurrency(http_threads).run();
 
     return 0;
-}
\ No newline at end of file
+}
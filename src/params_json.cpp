@@ -0,0 +1,133 @@
+#include "params_json.h"
+
+#include <cstdint>
+
+namespace
+{
+    // Energies and ages are stored as int16_t in the grid planes, where energies
+    // that build up past a single parameter saturate
+    const int32_t MAX_PARAMETER_VALUE = INT16_MAX;
+
+    bool read_int(const nlohmann::json &value, int32_t &field)
+    {
+        if (!value.is_number_integer() or value.get<int64_t>() < 0 or value.get<int64_t>() > MAX_PARAMETER_VALUE)
+            return false;
+        field = value.get<int32_t>();
+        return true;
+    }
+
+    bool read_probability(const nlohmann::json &value, double &field)
+    {
+        if (!value.is_number() or !(value.get<double>() >= 0 and value.get<double>() <= 1))
+            return false;
+        field = value.get<double>();
+        return true;
+    }
+
+    template <typename species_t>
+    bool species_from_json(const nlohmann::json &json, species_params_t &params, std::string &error)
+    {
+        if (!json.is_object())
+        {
+            error = std::string(species_t::name) + " must be an object";
+            return false;
+        }
+
+        for (const auto &[key, value] : json.items())
+        {
+            bool valid;
+            if (key == "maximum_age")
+                valid = read_int(value, params.maximum_age);
+            else if (key == "reproduction_probability")
+                valid = read_probability(value, params.reproduction_probability);
+            else if (key == "move_probability" and species_t::moves)
+                valid = read_probability(value, params.move_probability);
+            else if (key == "eat_probability" and species_t::prey != empty)
+                valid = read_probability(value, params.eat_probability);
+            else if (key == "energy_gain" and species_t::prey != empty)
+                valid = read_int(value, params.energy_gain);
+            else
+            {
+                error = "Unknown parameter " + std::string(species_t::name) + "." + key;
+                return false;
+            }
+
+            if (!valid)
+            {
+                error = "Invalid parameter " + std::string(species_t::name) + "." + key;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool params_from_json(const nlohmann::json &json, simulation_params_t &params, std::string &error)
+{
+    if (!json.is_object())
+    {
+        error = "parameters must be an object";
+        return false;
+    }
+
+    for (const auto &[key, value] : json.items())
+    {
+        int32_t *energy = key == "start_energy"             ? &params.start_energy
+                          : key == "move_energy"            ? &params.move_energy
+                          : key == "reproduction_energy"    ? &params.reproduction_energy
+                          : key == "reproduction_threshold" ? &params.reproduction_threshold
+                                                            : nullptr;
+        if (energy)
+        {
+            if (!read_int(value, *energy))
+            {
+                error = "Invalid parameter " + key;
+                return false;
+            }
+            continue;
+        }
+
+        bool known = false, valid = true;
+        for_each_species([&](auto species)
+                         {
+            if (key == species.name) {
+                known = true;
+                valid = species_from_json<decltype(species)>(value, params.of(species.type), error);
+            } });
+
+        if (!known)
+        {
+            error = "Unknown parameter " + key;
+            return false;
+        }
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
+nlohmann::json params_to_json(const simulation_params_t &params)
+{
+    nlohmann::json json = {
+        {"start_energy", params.start_energy},
+        {"move_energy", params.move_energy},
+        {"reproduction_energy", params.reproduction_energy},
+        {"reproduction_threshold", params.reproduction_threshold},
+    };
+
+    for_each_species([&](auto species)
+                     {
+        const species_params_t &species_params = params.of(species.type);
+        nlohmann::json json_species = {
+            {"maximum_age", species_params.maximum_age},
+            {"reproduction_probability", species_params.reproduction_probability},
+        };
+        if (species.moves)
+            json_species["move_probability"] = species_params.move_probability;
+        if (species.prey != empty) {
+            json_species["eat_probability"] = species_params.eat_probability;
+            json_species["energy_gain"] = species_params.energy_gain;
+        }
+        json[species.name] = std::move(json_species); });
+    return json;
+}
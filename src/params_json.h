@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "json.hpp"
+#include "species.h"
+
+// Reads the parameters of a run from a JSON object such as
+//
+//   {"move_energy": 5, "herbivore": {"move_probability": 0.5, "maximum_age": 40}}
+//
+// Top-level keys are the fields of simulation_params_t, and the species
+// names (see species_traits_t::name) hold the fields of species_params_t
+// that apply to that species. Keys left out keep their value in `params`.
+// Returns false with a message in `error` if a key is unknown or a value is
+// out of range (probabilities in [0, 1], energies and ages in [0, 32767]).
+bool params_from_json(const nlohmann::json &json, simulation_params_t &params, std::string &error);
+
+// The parameters in the format read by params_from_json()
+nlohmann::json params_to_json(const simulation_params_t &params);
@@ -0,0 +1,597 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <bit>
+#include <random>
+
+#include "alloc_counter.h"
+#include "cell_rng.h"
+
+namespace
+{
+    // Offsets of the 4-neighborhood, in the order the entities visit it.
+    // The opposite of direction `dir` is `dir ^ 1`.
+    const int32_t DIR_DI[4] = {0, 0, 1, -1};
+    const int32_t DIR_DJ[4] = {1, -1, 0, 0};
+
+    const uint8_t NO_DIRECTION = 0xF;
+    const uint8_t NO_CLAIM = 0xFF;
+
+    // Kinds of claim on a destination cell, stored above the direction in tick_scratch_t::winner
+    const uint8_t CLAIM_BIRTH = 0;
+    const uint8_t CLAIM_MOVE = 4;
+
+    // Independent random streams of a cell within a tick, index of simulation_t::stream_keys
+    enum rng_stream_t : uint32_t
+    {
+        EAT_STREAM,
+        PREY_STREAM,
+        ACTION_STREAM,
+        DESTINATION_STREAM
+    };
+
+    uint8_t birth_dir(uint8_t intent) { return intent & 0xF; }
+    uint8_t move_dir(uint8_t intent) { return intent >> 4; }
+
+    // Energy as stored in the int16_t planes. Gains and costs are each at most
+    // INT16_MAX (see params_from_json()) but add up over ticks, so they saturate
+    // rather than wrap around into the opposite sign.
+    int32_t saturate_energy(int32_t energy) { return std::clamp<int32_t>(energy, INT16_MIN, INT16_MAX); }
+}
+
+size_t grid_planes_t::memory_needed(size_t row_stride, size_t rows)
+{
+    size_t num_cells = row_stride * rows;
+    size_t num_words = (num_cells + 2 * row_stride) / 64;
+    return (1 + NUM_SPECIES) * arena_t::footprint<uint64_t>(num_words) + arena_t::footprint<entity_type_t>(num_cells) +
+           2 * arena_t::footprint<int16_t>(num_cells) + arena_t::footprint<uint32_t>(num_cells);
+}
+
+void grid_planes_t::assign(size_t row_stride, size_t rows, arena_t &arena)
+{
+    size_t num_cells = row_stride * rows;
+    stride = row_stride;
+
+    // Planes are replaced rather than resized, so that they take the new arena.
+    // The bitboards have a guard row above and below the grid.
+    occupancy = bitboard_t((num_cells + 2 * stride) / 64, 0, bitboard_t::allocator_type(arena));
+    for (bitboard_t &bits : type_bits)
+        bits = bitboard_t((num_cells + 2 * stride) / 64, 0, bitboard_t::allocator_type(arena));
+    type = plane_t<entity_type_t>(num_cells, empty, arena_allocator<entity_type_t>(arena));
+    energy = plane_t<int16_t>(num_cells, 0, arena_allocator<int16_t>(arena));
+    age = plane_t<int16_t>(num_cells, 0, arena_allocator<int16_t>(arena));
+    last_tick = plane_t<uint32_t>(num_cells, 0, arena_allocator<uint32_t>(arena));
+}
+
+void grid_planes_t::store(size_t idx, const entity_t &e)
+{
+    size_t word = bit(idx) / 64;
+    uint64_t mask = uint64_t(1) << (bit(idx) % 64);
+    if (type[idx] != empty)
+        type_bits[type[idx] - 1][word] &= ~mask;
+
+    if (e.type == empty)
+        occupancy[word] &= ~mask;
+    else
+    {
+        occupancy[word] |= mask;
+        type_bits[e.type - 1][word] |= mask;
+    }
+
+    type[idx] = e.type;
+    energy[idx] = int16_t(e.energy);
+    age[idx] = int16_t(e.age);
+    last_tick[idx] = e.last_tick;
+}
+
+size_t tick_scratch_t::memory_needed(size_t num_cells)
+{
+    return 4 * arena_t::footprint<uint8_t>(num_cells) + arena_t::footprint<int16_t>(num_cells);
+}
+
+void tick_scratch_t::assign(size_t num_cells, arena_t &arena)
+{
+    eat_claims = plane_t<uint8_t>(num_cells, 0, arena_allocator<uint8_t>(arena));
+    eaten_by = plane_t<uint8_t>(num_cells, NO_DIRECTION, arena_allocator<uint8_t>(arena));
+    intents = plane_t<uint8_t>(num_cells, NO_DIRECTION | NO_DIRECTION << 4, arena_allocator<uint8_t>(arena));
+    energy = plane_t<int16_t>(num_cells, 0, arena_allocator<int16_t>(arena));
+    winner = plane_t<uint8_t>(num_cells, NO_CLAIM, arena_allocator<uint8_t>(arena));
+}
+
+simulation_t::simulation_t(worker_pool_t &pool) : pool(pool)
+{
+    start(DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, 0, 0, 0, 0);
+}
+
+simulation_t::~simulation_t()
+{
+    wait_idle();
+}
+
+void simulation_t::start(uint32_t width, uint32_t height, uint32_t num_plant, uint32_t num_herbi, uint32_t num_carni, uint64_t run_seed,
+                         const simulation_params_t &run_params)
+{
+    // A timed out tick may still be running
+    wait_idle();
+
+    // Everything that can throw is allocated before the current run is
+    // touched, so a grid that does not fit leaves it as it was
+    uint32_t num_tiles = (height + TILE_ROWS - 1) / TILE_ROWS * ((width + TILE_COLS - 1) / TILE_COLS);
+    std::vector<uint64_t> new_tile_ns(num_tiles, 0);
+    std::vector<population_stats_t> new_tile_stats(num_tiles);
+    std::vector<worker_pool_t::phase_t> new_phases = build_phases(num_tiles);
+
+    // Clear the entity grid. The buffers of the previous run go with the old
+    // block of the arena, and the new one is sized so that they all fit.
+    arena.reset(memory_needed(width, height));
+    grid_width = width;
+    grid_height = height;
+    grid_stride = padded_width(width);
+    entity_grid.assign(grid_stride, grid_height, arena);
+    next_grid.assign(grid_stride, grid_height, arena);
+    scratch.assign(size_t(grid_stride) * grid_height, arena);
+    tile_ns = std::move(new_tile_ns);
+    tile_stats = std::move(new_tile_stats);
+    tick_phases = std::move(new_phases);
+    tick = 0;
+    run++;
+    params = run_params;
+    for (entity_type_t type : ALL_SPECIES)
+    {
+        const species_params_t &species = params.of(type);
+        thresholds[type - 1] = {probability_threshold(species.reproduction_probability), probability_threshold(species.move_probability),
+                                probability_threshold(species.eat_probability)};
+    }
+
+    // Key of the initial placement and of the per-cell random streams of this run
+    seed = run_seed;
+    std::mt19937_64 gen(seed);
+
+    std::uniform_int_distribution<uint32_t> rand_row(0, grid_height - 1);
+    std::uniform_int_distribution<uint32_t> rand_col(0, grid_width - 1);
+
+    // Create the entities
+    pos_t creation_pos;
+
+    for (size_t idx = 0; idx != num_plant; idx++)
+    {
+        creation_pos.i = rand_row(gen);
+        creation_pos.j = rand_col(gen);
+        entity_grid.store(index(creation_pos.i, creation_pos.j), {plant, params.start_energy, 0, 0});
+    }
+
+    for (size_t idx = 0; idx != num_herbi; idx++)
+    {
+        creation_pos.i = rand_row(gen);
+        creation_pos.j = rand_col(gen);
+        entity_grid.store(index(creation_pos.i, creation_pos.j), {herbivore, params.start_energy, 0, 0});
+    }
+
+    for (size_t idx = 0; idx != num_carni; idx++)
+    {
+        creation_pos.i = rand_row(gen);
+        creation_pos.j = rand_col(gen);
+        entity_grid.store(index(creation_pos.i, creation_pos.j), {carnivore, params.start_energy, 0, 0});
+    }
+
+    // Statistics of the initial grid, the only ones gathered by a scan of the grid
+    population_stats = {};
+    for (uint32_t i = 0; i != grid_height; i++)
+        for (uint32_t word = 0; word != words_per_row(); word++)
+            for (uint64_t occupied = occupied_word(i, word); occupied != 0; occupied &= occupied - 1)
+            {
+                entity_t e = at(i, word * 64 + std::countr_zero(occupied));
+                population_stats.of(e.type).add(e);
+            }
+}
+
+uint32_t simulation_t::padded_width(uint32_t width)
+{
+    // Pad every row to a whole number of cache lines
+    const uint32_t cells_per_line = CACHE_LINE_SIZE / sizeof(entity_type_t);
+    return (width + cells_per_line - 1) / cells_per_line * cells_per_line;
+}
+
+size_t simulation_t::memory_needed(uint32_t width, uint32_t height)
+{
+    size_t row_stride = padded_width(width);
+    return 2 * grid_planes_t::memory_needed(row_stride, height) + tick_scratch_t::memory_needed(row_stride * height);
+}
+
+void simulation_t::step()
+{
+    begin_step();
+    wait_step(std::chrono::microseconds::max());
+}
+
+std::vector<worker_pool_t::phase_t> simulation_t::build_phases(uint32_t num_tiles)
+{
+    auto changing = [this](uint32_t i, uint32_t word)
+    { return changing_word(i, word); };
+
+    // Phases 1 to 3 only concern entities; phases 4 and 5 the cells that may change
+    return {
+        {num_tiles, [this](size_t tile)
+         { for_species_in_tile(tile, [this]<typename species_t>(species_t, uint32_t i, uint32_t j)
+                               { claim_prey<species_t>(i, j); }); }},
+        {num_tiles, [this](size_t tile)
+         { for_species_in_tile(tile, [this]<typename species_t>(species_t, uint32_t i, uint32_t j)
+                               { resolve_prey<species_t>(i, j); }); }},
+        {num_tiles, [this](size_t tile)
+         { for_species_in_tile(tile, [this]<typename species_t>(species_t, uint32_t i, uint32_t j)
+                               { plan_actions<species_t>(i, j); }); }},
+        {num_tiles, [this, changing](size_t tile)
+         { for_tile(tile, changing, [this](uint32_t i, uint32_t j)
+                    { resolve_destinations(i, j); }); }},
+        {num_tiles, [this, changing](size_t tile)
+         { for_tile(tile, changing, [this, tile](uint32_t i, uint32_t j)
+                    { write_next(i, j, tile_stats[tile]); }); }},
+        // The next generation becomes the current one
+        {1, [this](size_t)
+         {
+             std::swap(entity_grid, next_grid);
+             population_stats = {};
+             for (const population_stats_t &stats : tile_stats)
+                 for (entity_type_t type : ALL_SPECIES)
+                     population_stats.of(type).merge(stats.of(type));
+         }},
+    };
+}
+
+void simulation_t::begin_step()
+{
+    // Waits for a previous tick that timed out before touching the counter
+    wait_idle();
+    uint64_t allocations_before = thread_heap_allocations();
+    tick++;
+    std::fill(tile_ns.begin(), tile_ns.end(), 0);
+    std::fill(tile_stats.begin(), tile_stats.end(), population_stats_t{});
+    for (uint32_t stream = 0; stream != std::size(stream_keys); stream++)
+        stream_keys[stream] = cell_rng_t::stream_key(seed, tick, stream);
+
+    // Allocations of this thread while starting the tick count toward it too, so
+    // they are taken off the baseline that wait_step() compares the pool against
+    tick_start_allocations = pool.allocations();
+    pending_work = pool.dispatch(tick_phases);
+    tick_start_allocations -= thread_heap_allocations() - allocations_before;
+}
+
+bool simulation_t::wait_step(std::chrono::microseconds timeout)
+{
+    auto wait_start = std::chrono::steady_clock::now();
+    bool done = pool.wait_for(pending_work, timeout);
+    uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wait_start).count();
+
+    tick_metrics.last_wait_us = wait_us;
+    tick_metrics.max_wait_us = std::max(tick_metrics.max_wait_us, wait_us);
+    tick_metrics.total_wait_us += wait_us;
+    if (done)
+    {
+        tick_metrics.ticks++;
+        tick_metrics.last_tick_allocations = pool.allocations() - tick_start_allocations;
+    }
+    else
+        tick_metrics.timeouts++;
+
+    return done;
+}
+
+uint64_t simulation_t::occupied_word(uint32_t i, uint32_t word) const
+{
+    return i < grid_height and word < words_per_row() ? entity_grid.occupancy[(size_t(i) + 1) * words_per_row() + word] : 0;
+}
+
+uint64_t simulation_t::species_word(entity_type_t type, uint32_t i, uint32_t word) const
+{
+    return entity_grid.bits_of(type)[(size_t(i) + 1) * words_per_row() + word];
+}
+
+uint64_t simulation_t::changing_word(uint32_t i, uint32_t word) const
+{
+    uint64_t occupied = occupied_word(i, word);
+
+    // Cells next to an entity, which it may move or give birth into
+    uint64_t reachable = occupied | occupied << 1 | occupied >> 1 |
+                         occupied_word(i, word - 1) >> 63 | occupied_word(i, word + 1) << 63 |
+                         occupied_word(i - 1, word) | occupied_word(i + 1, word);
+
+    // Cells occupied two generations ago, still set in the buffer about to be overwritten
+    return reachable | next_grid.occupancy[(size_t(i) + 1) * words_per_row() + word];
+}
+
+template <typename words_t, typename phase_t>
+void simulation_t::for_tile(uint32_t tile, words_t active_word, phase_t phase)
+{
+    auto tile_start = std::chrono::steady_clock::now();
+
+    uint32_t first_row = tile / tiles_across() * TILE_ROWS;
+    uint32_t last_row = std::min(first_row + TILE_ROWS, grid_height);
+    uint32_t first_col = tile % tiles_across() * TILE_COLS;
+    uint32_t last_col = std::min(first_col + TILE_COLS, grid_width);
+
+    // Tiles span whole words of the occupancy bitmap, only the last word of a row has padding
+    for (uint32_t i = first_row; i != last_row; i++)
+    {
+        for (uint32_t word = first_col / 64; word * 64 < last_col; word++)
+        {
+            uint64_t active = active_word(i, word);
+            if (last_col - word * 64 < 64)
+                active &= (uint64_t(1) << (last_col - word * 64)) - 1;
+
+            if (active == ~uint64_t(0))
+            {
+                for (uint32_t j = word * 64; j != word * 64 + 64; j++)
+                    phase(i, j);
+                continue;
+            }
+
+            for (; active != 0; active &= active - 1)
+                phase(i, word * 64 + std::countr_zero(active));
+        }
+    }
+
+    // Only one worker runs a given tile in a phase, and phases are separated by a barrier
+    tile_ns[tile] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tile_start).count();
+}
+
+template <typename kernel_t>
+void simulation_t::for_species_in_tile(uint32_t tile, kernel_t kernel)
+{
+    for_each_species([&](auto species)
+                     { for_tile(
+                           tile, [&](uint32_t i, uint32_t word)
+                           { return species_word(species.type, i, word); },
+                           [&](uint32_t i, uint32_t j)
+                           { kernel(species, i, j); }); });
+}
+
+size_t simulation_t::neighbor_index(size_t idx, uint32_t dir) const
+{
+    return idx + DIR_DI[dir] * ptrdiff_t(grid_stride) + DIR_DJ[dir];
+}
+
+uint32_t simulation_t::inside_neighbors(uint32_t i, uint32_t j) const
+{
+    return uint32_t(j + 1 < grid_width) | uint32_t(j > 0) << 1 | uint32_t(i + 1 < grid_height) << 2 | uint32_t(i > 0) << 3;
+}
+
+template <typename species_t>
+bool simulation_t::survives_aging(size_t idx) const
+{
+    return (!species_t::needs_energy or entity_grid.energy[idx] > 0) and entity_grid.age[idx] < params.of(species_t::type).maximum_age;
+}
+
+bool simulation_t::is_claimed(uint32_t i, uint32_t j) const
+{
+    size_t idx = index(i, j);
+    for (uint32_t dirs = entity_grid.occupied_neighbors(idx) & inside_neighbors(i, j); dirs != 0; dirs &= dirs - 1)
+    {
+        uint32_t dir = std::countr_zero(dirs);
+        if (scratch.eat_claims[neighbor_index(idx, dir)] & (1 << (dir ^ 1)))
+            return true;
+    }
+    return false;
+}
+
+bool simulation_t::claim_won(uint32_t i, uint32_t j, uint32_t dir, uint8_t kind) const
+{
+    return dir != NO_DIRECTION and scratch.winner[neighbor_index(index(i, j), dir)] == ((dir ^ 1) | kind);
+}
+
+// Phase 1: every predator that survives the tick tries to eat each neighboring prey
+template <typename species_t>
+void simulation_t::claim_prey(uint32_t i, uint32_t j)
+{
+    size_t idx = index(i, j);
+    scratch.eat_claims[idx] = 0;
+
+    if constexpr (species_t::prey != empty)
+    {
+        using prey_t = species_traits_t<species_t::prey>;
+        if (!survives_aging<species_t>(idx))
+            return;
+
+        uint64_t eat_threshold = thresholds[species_t::type - 1].eat;
+        cell_rng_t rng(stream_keys[EAT_STREAM], i, j);
+
+        for (uint32_t dirs = entity_grid.neighbors_of_type(idx, species_t::prey) & inside_neighbors(i, j); dirs != 0; dirs &= dirs - 1)
+        {
+            uint32_t dir = std::countr_zero(dirs);
+            if (!survives_aging<prey_t>(neighbor_index(idx, dir)))
+                continue;
+
+            if (rng.chance(eat_threshold))
+                scratch.eat_claims[idx] |= 1 << dir;
+        }
+    }
+}
+
+// Phase 2: a claimed prey is eaten by one of the predators that claimed it.
+// Predators that are eaten themselves (herbivores claimed by a carnivore) lose their claims.
+template <typename species_t>
+void simulation_t::resolve_prey(uint32_t i, uint32_t j)
+{
+    size_t idx = index(i, j);
+    scratch.eaten_by[idx] = NO_DIRECTION;
+
+    if constexpr (is_prey(species_t::type))
+    {
+        uint8_t claimants[4];
+        uint32_t num_claimants = 0;
+
+        for (uint32_t dirs = entity_grid.occupied_neighbors(idx) & inside_neighbors(i, j); dirs != 0; dirs &= dirs - 1)
+        {
+            uint32_t dir = std::countr_zero(dirs);
+            if (!(scratch.eat_claims[neighbor_index(idx, dir)] & (1 << (dir ^ 1))))
+                continue;
+
+            if (!is_claimed(i + DIR_DI[dir], j + DIR_DJ[dir]))
+                claimants[num_claimants++] = dir;
+        }
+
+        if (num_claimants == 0)
+            return;
+
+        cell_rng_t rng(stream_keys[PREY_STREAM], i, j);
+        scratch.eaten_by[idx] = claimants[rng.below(num_claimants)];
+    }
+}
+
+// Phase 3: every entity that is neither dead nor eaten collects the energy of
+// the prey it won and picks the cells for its offspring and its move.
+// Candidate cells are the neighbors that are empty and the ones it just ate.
+template <typename species_t>
+void simulation_t::plan_actions(uint32_t i, uint32_t j)
+{
+    size_t idx = index(i, j);
+    uint8_t &intent = scratch.intents[idx];
+    intent = NO_DIRECTION | NO_DIRECTION << 4;
+
+    if (scratch.eaten_by[idx] != NO_DIRECTION or !survives_aging<species_t>(idx))
+        return;
+
+    const species_params_t &species = params.of(species_t::type);
+    const species_thresholds_t &threshold = thresholds[species_t::type - 1];
+    int32_t energy = entity_grid.energy[idx];
+
+    uint32_t inside = inside_neighbors(i, j);
+    uint32_t occupied = entity_grid.occupied_neighbors(idx) & inside;
+    uint32_t free_dirs = ~occupied & inside;
+
+    if constexpr (species_t::prey != empty)
+    {
+        for (uint32_t dirs = occupied; dirs != 0; dirs &= dirs - 1)
+        {
+            uint32_t dir = std::countr_zero(dirs);
+            if (scratch.eaten_by[neighbor_index(idx, dir)] == (dir ^ 1))
+            {
+                energy += species.energy_gain;
+                free_dirs |= 1 << dir;
+            }
+        }
+    }
+    energy = saturate_energy(energy);
+    scratch.energy[idx] = int16_t(energy);
+
+    uint8_t empty_dirs[4];
+    uint32_t num_empty = 0;
+    for (; free_dirs != 0; free_dirs &= free_dirs - 1)
+        empty_dirs[num_empty++] = std::countr_zero(free_dirs);
+
+    cell_rng_t rng(stream_keys[ACTION_STREAM], i, j);
+
+    uint8_t birth = NO_DIRECTION;
+    uint8_t move = NO_DIRECTION;
+
+    if (rng.chance(threshold.reproduction) and
+        (!species_t::reproduction_costs_energy or energy > params.reproduction_threshold) and num_empty != 0)
+    {
+        uint32_t pick = rng.below(num_empty);
+        birth = empty_dirs[pick];
+        empty_dirs[pick] = empty_dirs[--num_empty];
+    }
+
+    if constexpr (species_t::moves)
+    {
+        if (rng.chance(threshold.move) and num_empty != 0)
+            move = empty_dirs[rng.below(num_empty)];
+    }
+
+    intent = birth | move << 4;
+}
+
+// Phase 4: a cell that is empty (or whose entity was eaten) goes to one of the
+// neighbors whose offspring or move claims it
+void simulation_t::resolve_destinations(uint32_t i, uint32_t j)
+{
+    size_t idx = index(i, j);
+    scratch.winner[idx] = NO_CLAIM;
+
+    if (entity_grid.type[idx] != empty and scratch.eaten_by[idx] == NO_DIRECTION)
+        return;
+
+    uint8_t claims[4];
+    uint32_t num_claims = 0;
+
+    for (uint32_t dirs = entity_grid.occupied_neighbors(idx) & inside_neighbors(i, j); dirs != 0; dirs &= dirs - 1)
+    {
+        uint32_t dir = std::countr_zero(dirs);
+
+        // A neighbor never claims the same cell for its offspring and its move
+        uint8_t intent = scratch.intents[neighbor_index(idx, dir)];
+        if (birth_dir(intent) == (dir ^ 1))
+            claims[num_claims++] = dir | CLAIM_BIRTH;
+        else if (move_dir(intent) == (dir ^ 1))
+            claims[num_claims++] = dir | CLAIM_MOVE;
+    }
+
+    if (num_claims == 0)
+        return;
+
+    cell_rng_t rng(stream_keys[DESTINATION_STREAM], i, j);
+    scratch.winner[idx] = claims[rng.below(num_claims)];
+}
+
+// Phase 5: computes the cell in the next generation. Cells of every species
+// and empty ones are interleaved here, so the species is looked up per cell.
+void simulation_t::write_next(uint32_t i, uint32_t j, population_stats_t &tile_stats)
+{
+    size_t idx = index(i, j);
+    entity_type_t type = entity_grid.type[idx];
+    bool acted = false;
+
+    // Entity that stays in the cell, or the one that moves or is born into it
+    entity_t next = {empty, 0, 0, 0};
+    with_species(type, [&]<typename species_t>(species_t)
+                 {
+        if (scratch.eaten_by[idx] != NO_DIRECTION)
+        {
+            tile_stats.of(type).eaten++;
+            return;
+        }
+        if (!survives_aging<species_t>(idx))
+        {
+            tile_stats.of(type).deaths++;
+            return;
+        }
+
+        acted = true;
+        uint8_t intent = scratch.intents[idx];
+        if (!claim_won(i, j, move_dir(intent), CLAIM_MOVE))
+        {
+            next = {type, scratch.energy[idx], entity_grid.age[idx] + 1, tick};
+            if (species_t::reproduction_costs_energy and claim_won(i, j, birth_dir(intent), CLAIM_BIRTH))
+                next.energy -= params.reproduction_energy;
+        } });
+
+    if (!acted and scratch.winner[idx] != NO_CLAIM)
+    {
+        uint32_t dir = scratch.winner[idx] & 3;
+        uint32_t ni = i + DIR_DI[dir];
+        uint32_t nj = j + DIR_DJ[dir];
+        size_t parent_idx = index(ni, nj);
+
+        with_species(entity_grid.type[parent_idx], [&]<typename parent_t>(parent_t)
+                     {
+            if ((scratch.winner[idx] & CLAIM_MOVE) == 0)
+            {
+                next = {parent_t::type, parent_t::needs_energy ? params.start_energy : 0, 0, tick};
+                tile_stats.of(parent_t::type).births++;
+            }
+            else
+            {
+                next = {parent_t::type, scratch.energy[parent_idx] - params.move_energy, entity_grid.age[parent_idx] + 1, tick};
+                if (parent_t::reproduction_costs_energy and claim_won(ni, nj, birth_dir(scratch.intents[parent_idx]), CLAIM_BIRTH))
+                    next.energy -= params.reproduction_energy;
+            } });
+    }
+
+    next.energy = saturate_energy(next.energy);
+
+    // Cells that stay empty keep the tick of their last change
+    if (next.type == empty)
+        next.last_tick = type == empty ? entity_grid.last_tick[idx] : tick;
+    else
+        tile_stats.of(next.type).add(next);
+    next_grid.store(idx, next);
+}
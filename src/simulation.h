@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "arena.h"
+#include "bitboard.h"
+#include "species.h"
+#include "worker_pool.h"
+
+// Grid dimensions
+const uint32_t DEFAULT_GRID_SIZE = 15;
+const uint32_t MAX_GRID_SIZE = 4096;
+
+// Size of the tiles processed by a single task of the tick engine. A tile
+// and its one-cell halo (about 25 bytes per cell over all the planes) fit in
+// the L2 cache, and its rows span whole cache lines of the type plane.
+const uint32_t TILE_ROWS = 32;
+const uint32_t TILE_COLS = 128;
+
+struct pos_t
+{
+    uint32_t i;
+    uint32_t j;
+
+	pos_t(int i, int j) : i(i), j(j) {};
+	pos_t() {};
+
+};
+
+// Value view of a single cell, assembled from the grid planes
+struct entity_t
+{
+    entity_type_t type;
+    int32_t energy;
+    int32_t age;
+    // Last tick in which this cell changed (its entity acted, was born, moved
+    // in or left), so that entities are not processed twice and clients can
+    // be sent only the cells that changed
+    uint32_t last_tick;
+};
+
+// Buffer of one value per cell, allocated from the arena of the simulation
+template <typename T>
+using plane_t = std::vector<T, arena_allocator<T>>;
+
+// Structure-of-arrays storage of the grid. Every field lives in its own plane
+// and all planes share the same padded row-major layout, so the passes that
+// only look at `type` touch a single byte per cell. The occupancy bitmap
+// lets the tick skip empty cells 64 at a time, and it and the bitboards of
+// every type answer which neighbors of a cell are empty or hold a given type
+// with a few shifts (see neighbor_mask()).
+struct grid_planes_t
+{
+    // Bit per cell, set when the cell is not empty
+    bitboard_t occupancy;
+    // Bit per cell for every species, set when the cell holds it (indexed by type - 1)
+    bitboard_t type_bits[NUM_SPECIES];
+    plane_t<entity_type_t> type;
+    plane_t<int16_t> energy;
+    plane_t<int16_t> age;
+    plane_t<uint32_t> last_tick;
+    size_t stride = 0;
+
+    // Bytes of arena taken by assign()
+    static size_t memory_needed(size_t row_stride, size_t rows);
+
+    // Allocates every plane from `arena` as `rows` rows of `row_stride` empty cells
+    void assign(size_t row_stride, size_t rows, arena_t &arena);
+
+    entity_t load(size_t idx) const { return {type[idx], energy[idx], age[idx], last_tick[idx]}; }
+    void store(size_t idx, const entity_t &e);
+    void clear(size_t idx, uint32_t tick) { store(idx, {empty, 0, 0, tick}); }
+
+    // Bit of the cell `idx` in the bitboards, past their top guard row
+    size_t bit(size_t idx) const { return idx + stride; }
+    const bitboard_t &bits_of(entity_type_t t) const { return type_bits[t - 1]; }
+
+    // Directions in which the neighbors of the cell are occupied, or hold a `t`
+    uint32_t occupied_neighbors(size_t idx) const { return neighbor_mask(occupancy.data(), bit(idx), stride); }
+    uint32_t neighbors_of_type(size_t idx, entity_type_t t) const { return neighbor_mask(bits_of(t).data(), bit(idx), stride); }
+};
+
+// Per-cell decisions of the phases of a tick, see simulation_t.
+// Directions index the 4-neighborhood (right, left, down, up).
+struct tick_scratch_t
+{
+    // Bitmask of the directions in which the entity tries to eat a neighbor
+    plane_t<uint8_t> eat_claims;
+    // Direction of the predator that eats the entity, NO_DIRECTION if none
+    plane_t<uint8_t> eaten_by;
+    // Direction of the offspring (low nibble) and of the move (high nibble), NO_DIRECTION if none
+    plane_t<uint8_t> intents;
+    // Energy of the entity after eating, before paying for reproduction or moving
+    plane_t<int16_t> energy;
+    // Neighbor whose offspring or move claims the cell (direction | kind), NO_CLAIM if none
+    plane_t<uint8_t> winner;
+
+    // Bytes of arena taken by assign()
+    static size_t memory_needed(size_t num_cells);
+
+    void assign(size_t num_cells, arena_t &arena);
+};
+
+// Population of a species after a tick and what happened to it during the tick
+struct species_stats_t
+{
+    uint64_t count = 0;
+    int64_t total_energy = 0;
+    int32_t min_energy = std::numeric_limits<int32_t>::max();
+    int32_t max_energy = std::numeric_limits<int32_t>::min();
+    int64_t total_age = 0;
+    int32_t min_age = std::numeric_limits<int32_t>::max();
+    int32_t max_age = std::numeric_limits<int32_t>::min();
+    uint64_t births = 0;
+    // Deaths of old age or starvation
+    uint64_t deaths = 0;
+    // Deaths by predation
+    uint64_t eaten = 0;
+
+    void add(const entity_t &e)
+    {
+        count++;
+        total_energy += e.energy;
+        min_energy = std::min(min_energy, e.energy);
+        max_energy = std::max(max_energy, e.energy);
+        total_age += e.age;
+        min_age = std::min(min_age, e.age);
+        max_age = std::max(max_age, e.age);
+    }
+
+    void merge(const species_stats_t &other)
+    {
+        count += other.count;
+        total_energy += other.total_energy;
+        min_energy = std::min(min_energy, other.min_energy);
+        max_energy = std::max(max_energy, other.max_energy);
+        total_age += other.total_age;
+        min_age = std::min(min_age, other.min_age);
+        max_age = std::max(max_age, other.max_age);
+        births += other.births;
+        deaths += other.deaths;
+        eaten += other.eaten;
+    }
+};
+
+// Statistics of every species (indexed by type - 1), gathered by each tile on
+// its own, so aligned to keep the tiles of different workers off the same cache line
+struct alignas(CACHE_LINE_SIZE) population_stats_t
+{
+    species_stats_t species[NUM_SPECIES];
+
+    species_stats_t &of(entity_type_t type) { return species[type - 1]; }
+    const species_stats_t &of(entity_type_t type) const { return species[type - 1]; }
+};
+
+// Timing of the ticks as seen by the callers waiting on them
+struct tick_metrics_t
+{
+    uint64_t ticks = 0;
+    uint64_t timeouts = 0;
+    uint64_t last_wait_us = 0;
+    uint64_t max_wait_us = 0;
+    uint64_t total_wait_us = 0;
+    // Heap allocations made by the last complete tick, expected to be 0
+    uint64_t last_tick_allocations = 0;
+};
+
+// Tick engine: entities are plain data in the grid and each tick is executed
+// by a fixed pool of workers.
+//
+// The grid is stored as row-major planes (see grid_planes_t). Rows are padded
+// so that every row of the type plane is a whole number of cache lines
+// (`row_stride` cells); the padding cells are always empty. The planes and
+// the scratch of the tick live in an arena sized by start() from the grid
+// dimensions (see memory_needed()), released at once by the next start().
+//
+// The grid is double buffered: a tick reads the current generation and writes
+// the next one, then swaps them. The tick runs as a sequence of phases over
+// TILE_ROWS x TILE_COLS tiles. Every phase only writes the cells of its own
+// tile and reads a one-cell halo of what the previous phase wrote in the
+// neighboring tiles; the barrier between phases is the only coordination, so
+// the tiles of a phase run in parallel without locks:
+//
+//   1. claim_prey: predators pick the neighbors they try to eat
+//   2. resolve_prey: a prey claimed by several predators is eaten by one of them
+//   3. plan_actions: survivors pick the cells for their offspring and move
+//   4. resolve_destinations: a cell claimed by several neighbors goes to one of them
+//   5. write_next: every cell of the next generation is computed from the above
+//
+// Phases only visit the cells they concern, found 64 at a time in the
+// occupancy bitmaps, so the cost of a tick follows the population rather than
+// the area. Scratch values of cells a phase skipped are stale and are only
+// read for cells that are occupied.
+//
+// Phases 1 to 3 visit the entities species by species, from the bitboard of
+// each, and their kernels are instantiated per species from species_traits_t,
+// so they do not branch on the type of the entity.
+//
+// Contested prey and cells are awarded at random among the claimants. A
+// predator that loses its prey gets no energy, a mover that loses its cell
+// stays put and an offspring that loses its cell is not born; neither pays.
+//
+// Population statistics are gathered as the last phase writes the entities
+// of the next generation and sees them being born, die or get eaten, per
+// tile, and added up when the generations are swapped (see stats()).
+//
+// Random draws come from streams keyed by (seed, tick, cell) (see cell_rng_t),
+// so they need no synchronization between workers and the outcome of a tick
+// does not depend on scheduling. Probabilities are turned into integer
+// thresholds once per run and compared against raw draws.
+class simulation_t
+{
+public:
+    explicit simulation_t(worker_pool_t &pool);
+    // Waits for a time step that timed out, it still refers to the grid
+    ~simulation_t();
+
+    // Resizes and clears the grid and randomly places the initial entities.
+    // The same seed and parameters always produce the same sequence of grids,
+    // whatever the number of workers. Throws std::bad_alloc if the grid does
+    // not fit in memory, leaving the current run as it was.
+    void start(uint32_t width, uint32_t height, uint32_t num_plant, uint32_t num_herbi, uint32_t num_carni, uint64_t run_seed,
+               const simulation_params_t &run_params = {});
+
+    // Bytes of arena a grid of `width` x `height` takes
+    static size_t memory_needed(uint32_t width, uint32_t height);
+    // Bytes of arena taken by the current grid
+    size_t memory_used() const { return arena.size(); }
+
+    // Advances the simulation by one time step
+    void step();
+
+    // Starts the next time step on the worker pool without waiting for it
+    void begin_step();
+
+    // Blocks until the time step started by begin_step() is complete or `timeout` expires.
+    // Returns whether the step is complete; the wait is recorded in metrics().
+    bool wait_step(std::chrono::microseconds timeout);
+
+    // Blocks until a time step that timed out is complete, so the grid can be read
+    void wait_idle() { pool.wait(pending_work); }
+
+    uint32_t width() const { return grid_width; }
+    uint32_t height() const { return grid_height; }
+    uint32_t row_stride() const { return grid_stride; }
+
+    entity_t at(uint32_t i, uint32_t j) const { return entity_grid.load(index(i, j)); }
+    const grid_planes_t &planes() const { return entity_grid; }
+
+    // Number of entities of `type` in the current generation
+    uint64_t population(entity_type_t type) const { return population_stats.of(type).count; }
+    // Population of every species in the current generation, with the births,
+    // deaths and predation of the last tick
+    const population_stats_t &stats() const { return population_stats; }
+
+    uint32_t current_tick() const { return tick; }
+    uint64_t current_seed() const { return seed; }
+    const simulation_params_t &current_params() const { return params; }
+    // Incremented by every start(), tells grids of different runs apart
+    uint32_t current_run() const { return run; }
+    const tick_metrics_t &metrics() const { return tick_metrics; }
+
+    uint32_t tiles_down() const { return (grid_height + TILE_ROWS - 1) / TILE_ROWS; }
+    uint32_t tiles_across() const { return (grid_width + TILE_COLS - 1) / TILE_COLS; }
+    // Time spent in each tile (row-major) during the last complete tick, over all its phases
+    const std::vector<uint64_t> &tile_times_ns() const { return tile_ns; }
+
+private:
+    // Runs `phase` on the cells of a tile set in `active_word(i, word)`, and adds
+    // the time it took to the tile
+    template <typename words_t, typename phase_t>
+    void for_tile(uint32_t tile, words_t active_word, phase_t phase);
+
+    // Runs `kernel(species, i, j)` on the entities of a tile, species by species,
+    // so the kernel is specialized for each of them
+    template <typename kernel_t>
+    void for_species_in_tile(uint32_t tile, kernel_t kernel);
+
+    // Phases of a tick over `num_tiles` tiles, see tick_phases
+    std::vector<worker_pool_t::phase_t> build_phases(uint32_t num_tiles);
+
+    // Cells of padding added to a row of `width` cells, so it is a whole number of cache lines
+    static uint32_t padded_width(uint32_t width);
+
+    uint32_t words_per_row() const { return grid_stride / 64; }
+    // Word of the occupancy bitmap of the current generation, 0 outside the grid
+    uint64_t occupied_word(uint32_t i, uint32_t word) const;
+    // Word of the bitboard of `type` in the current generation, `i` inside the grid
+    uint64_t species_word(entity_type_t type, uint32_t i, uint32_t word) const;
+    // Cells whose next generation must be written: the occupied ones, their
+    // neighbors and the cells still occupied in the buffer being overwritten
+    uint64_t changing_word(uint32_t i, uint32_t word) const;
+
+    template <typename species_t>
+    void claim_prey(uint32_t i, uint32_t j);
+    template <typename species_t>
+    void resolve_prey(uint32_t i, uint32_t j);
+    template <typename species_t>
+    void plan_actions(uint32_t i, uint32_t j);
+    void resolve_destinations(uint32_t i, uint32_t j);
+    void write_next(uint32_t i, uint32_t j, population_stats_t &tile_stats);
+
+    size_t index(uint32_t i, uint32_t j) const { return size_t(i) * grid_stride + j; }
+
+    // Index of the neighbor of the cell `idx` in direction `dir`, which must be inside the grid
+    size_t neighbor_index(size_t idx, uint32_t dir) const;
+
+    // Directions in which the neighbor of (i, j) is inside the grid
+    uint32_t inside_neighbors(uint32_t i, uint32_t j) const;
+
+    // Whether the entity of the cell, a `species_t`, outlives its age and energy limits this tick
+    template <typename species_t>
+    bool survives_aging(size_t idx) const;
+
+    // Whether any neighbor tries to eat the entity of the cell
+    bool is_claimed(uint32_t i, uint32_t j) const;
+
+    // Whether the claim of the entity at (i, j) on its neighbor in direction `dir` won.
+    // The claimed cell is always inside the grid.
+    bool claim_won(uint32_t i, uint32_t j, uint32_t dir, uint8_t kind) const;
+
+    worker_pool_t &pool;
+
+    // Memory of the planes and the scratch, declared first so it outlives them
+    arena_t arena;
+
+    // Current generation of the grid, the one the entities act on
+    grid_planes_t entity_grid;
+    // Next generation, written during a tick and swapped in at its end
+    grid_planes_t next_grid;
+    tick_scratch_t scratch;
+    // Phases of a tick, built by start() so that ticks do not allocate
+    std::vector<worker_pool_t::phase_t> tick_phases;
+    std::vector<uint64_t> tile_ns;
+    // Statistics of the next generation gathered by every tile during a tick
+    std::vector<population_stats_t> tile_stats;
+    population_stats_t population_stats;
+    uint32_t grid_width = 0;
+    uint32_t grid_height = 0;
+    uint32_t grid_stride = 0;
+    uint32_t tick = 0;
+    uint64_t seed = 0;
+    uint32_t run = 0;
+    simulation_params_t params;
+
+    // Probabilities of `params` as thresholds of cell_rng_t::chance(), indexed by type - 1
+    struct species_thresholds_t
+    {
+        uint64_t reproduction;
+        uint64_t move;
+        uint64_t eat;
+    };
+    species_thresholds_t thresholds[NUM_SPECIES];
+    // cell_rng_t::stream_key() of every random stream in the current tick
+    uint64_t stream_keys[4];
+
+    // Id of the work of the last time step on the pool
+    uint64_t pending_work = 0;
+
+    tick_metrics_t tick_metrics;
+    // Allocations counted when the tick in progress was started
+    uint64_t tick_start_allocations = 0;
+};
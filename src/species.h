@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+// Constants
+const uint32_t PLANT_MAXIMUM_AGE = 10;
+const uint32_t HERBIVORE_MAXIMUM_AGE = 50;
+const uint32_t CARNIVORE_MAXIMUM_AGE = 80;
+const uint32_t MAXIMUM_ENERGY = 200;
+const uint32_t THRESHOLD_ENERGY_FOR_REPRODUCTION = 20;
+const uint32_t MOVE_ENERGY = 5;
+const uint32_t CARNIVORE_ENERGY_GAIN = 20;
+const uint32_t HERBIVORE_ENERGY_GAIN = 30;
+const uint32_t REPRODUCTION_ENERGY = 10;
+const uint32_t START_ENERGY = 100;
+
+
+// Probabilities
+constexpr double PLANT_REPRODUCTION_PROBABILITY = 0.2;
+constexpr double HERBIVORE_REPRODUCTION_PROBABILITY = 0.075;
+constexpr double CARNIVORE_REPRODUCTION_PROBABILITY = 0.025;
+constexpr double HERBIVORE_MOVE_PROBABILITY = 0.7;
+constexpr double HERBIVORE_EAT_PROBABILITY = 0.9;
+constexpr double CARNIVORE_MOVE_PROBABILITY = 0.5;
+constexpr double CARNIVORE_EAT_PROBABILITY = 1.0;
+
+// Type definitions
+enum entity_type_t : uint8_t
+{
+    empty,
+    plant,
+    herbivore,
+    carnivore
+};
+
+// Parameters of a species that can change from one run to the next
+struct species_params_t
+{
+    int32_t maximum_age;
+    double reproduction_probability;
+    // Probability of trying to move every tick, for species that move
+    double move_probability;
+    // Probability of trying to eat each neighboring prey, and energy gained
+    // per prey eaten, for species that eat
+    double eat_probability;
+    int32_t energy_gain;
+};
+
+// Compile-time description of a species. The tick engine instantiates its
+// kernels once per species (see simulation_t), so these only cost a branch
+// where they are checked, and adding a species takes a new entity_type_t, a
+// specialization and an entry in ALL_SPECIES. The numbers are only defaults,
+// each run can override them (see simulation_params_t).
+template <entity_type_t species_type>
+struct species_traits_t;
+
+template <>
+struct species_traits_t<plant>
+{
+    static constexpr entity_type_t type = plant;
+    // Name of the species in the parameters of /start-simulation
+    static constexpr const char *name = "plant";
+    // Character of the species in the grids sent to clients
+    static constexpr char symbol = 'P';
+    // Type it eats, empty if it does not eat
+    static constexpr entity_type_t prey = empty;
+    // Whether it dies once out of energy; offspring of those that do start with START_ENERGY
+    static constexpr bool needs_energy = false;
+    // Whether reproducing takes THRESHOLD_ENERGY_FOR_REPRODUCTION and costs REPRODUCTION_ENERGY
+    static constexpr bool reproduction_costs_energy = false;
+    static constexpr bool moves = false;
+    static constexpr species_params_t default_params = {PLANT_MAXIMUM_AGE, PLANT_REPRODUCTION_PROBABILITY, 0, 0, 0};
+};
+
+template <>
+struct species_traits_t<herbivore>
+{
+    static constexpr entity_type_t type = herbivore;
+    static constexpr const char *name = "herbivore";
+    static constexpr char symbol = 'H';
+    static constexpr entity_type_t prey = plant;
+    static constexpr bool needs_energy = true;
+    static constexpr bool reproduction_costs_energy = true;
+    static constexpr bool moves = true;
+    static constexpr species_params_t default_params = {HERBIVORE_MAXIMUM_AGE, HERBIVORE_REPRODUCTION_PROBABILITY, HERBIVORE_MOVE_PROBABILITY,
+                                                        HERBIVORE_EAT_PROBABILITY, HERBIVORE_ENERGY_GAIN};
+};
+
+template <>
+struct species_traits_t<carnivore>
+{
+    static constexpr entity_type_t type = carnivore;
+    static constexpr const char *name = "carnivore";
+    static constexpr char symbol = 'C';
+    static constexpr entity_type_t prey = herbivore;
+    static constexpr bool needs_energy = true;
+    static constexpr bool reproduction_costs_energy = true;
+    static constexpr bool moves = true;
+    static constexpr species_params_t default_params = {CARNIVORE_MAXIMUM_AGE, CARNIVORE_REPRODUCTION_PROBABILITY, CARNIVORE_MOVE_PROBABILITY,
+                                                        CARNIVORE_EAT_PROBABILITY, CARNIVORE_ENERGY_GAIN};
+};
+
+// Every species, in the order of entity_type_t
+constexpr entity_type_t ALL_SPECIES[] = {plant, herbivore, carnivore};
+constexpr size_t NUM_SPECIES = std::size(ALL_SPECIES);
+
+// Character of every entity_type_t in the grids sent to clients, indexed by type
+constexpr std::array<char, NUM_SPECIES + 1> ENTITY_SYMBOLS = []<size_t... idx>(std::index_sequence<idx...>)
+{ return std::array<char, NUM_SPECIES + 1>{' ', species_traits_t<ALL_SPECIES[idx]>::symbol...}; }(std::make_index_sequence<NUM_SPECIES>{});
+
+// Whether some species eats `type`
+constexpr bool is_prey(entity_type_t type)
+{
+    return [type]<size_t... idx>(std::index_sequence<idx...>)
+    { return ((species_traits_t<ALL_SPECIES[idx]>::prey == type) or ...); }(std::make_index_sequence<NUM_SPECIES>{});
+}
+
+// Calls f(species_traits_t<type>{}) for every species
+template <typename function_t>
+void for_each_species(function_t &&f)
+{
+    [&]<size_t... idx>(std::index_sequence<idx...>)
+    { (f(species_traits_t<ALL_SPECIES[idx]>{}), ...); }(std::make_index_sequence<NUM_SPECIES>{});
+}
+
+// Calls f(species_traits_t<type>{}) for the species of `type`, nothing if it is empty
+template <typename function_t>
+void with_species(entity_type_t type, function_t &&f)
+{
+    for_each_species([&](auto species)
+                     {
+        if (species.type == type)
+            f(species); });
+}
+
+// Parameters of a run. Defaults to the constants above.
+struct simulation_params_t
+{
+    // Energy of the initial entities and of the offspring of the species that need energy
+    int32_t start_energy = START_ENERGY;
+    int32_t move_energy = MOVE_ENERGY;
+    int32_t reproduction_energy = REPRODUCTION_ENERGY;
+    int32_t reproduction_threshold = THRESHOLD_ENERGY_FOR_REPRODUCTION;
+    // Indexed by type - 1
+    species_params_t species[NUM_SPECIES];
+
+    simulation_params_t()
+    {
+        for_each_species([this](auto traits)
+                         { species[traits.type - 1] = traits.default_params; });
+    }
+
+    species_params_t &of(entity_type_t type) { return species[type - 1]; }
+    const species_params_t &of(entity_type_t type) const { return species[type - 1]; }
+};
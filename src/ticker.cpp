@@ -0,0 +1,141 @@
+#include "ticker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+
+ticker_t::ticker_t(std::function<bool()> tick_fn) : tick_fn(std::move(tick_fn))
+{
+    thread = std::thread(&ticker_t::loop, this);
+}
+
+ticker_t::~ticker_t()
+{
+    {
+        std::lock_guard lk(mtx);
+        stopping = true;
+    }
+    rate_cv.notify_all();
+    thread.join();
+
+    // Steps that never ran still get their answer
+    for (step_request_t &request : requested_steps)
+        answer(request, steps_result_t::stopped);
+}
+
+void ticker_t::set_rate(double new_rate)
+{
+    {
+        std::lock_guard lk(mtx);
+        ticks_per_second = new_rate > 0 ? new_rate : 0;
+    }
+    rate_cv.notify_all();
+}
+
+double ticker_t::rate()
+{
+    std::lock_guard lk(mtx);
+    return ticks_per_second;
+}
+
+void ticker_t::request_steps(uint32_t steps, std::function<void(steps_result_t)> on_done)
+{
+    {
+        std::lock_guard lk(mtx);
+        requested_steps.push_back({steps, std::move(on_done)});
+    }
+    rate_cv.notify_all();
+}
+
+ticker_t::steps_result_t ticker_t::tick()
+{
+    try
+    {
+        return tick_fn() ? steps_result_t::done : steps_result_t::timed_out;
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "tick failed: %s\n", e.what());
+        return steps_result_t::failed;
+    }
+}
+
+void ticker_t::answer(step_request_t &request, steps_result_t result)
+{
+    try
+    {
+        request.on_done(result);
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "answer to steps failed: %s\n", e.what());
+    }
+}
+
+bool ticker_t::busy()
+{
+    std::lock_guard lk(mtx);
+    return running_steps or !requested_steps.empty();
+}
+
+void ticker_t::loop()
+{
+    using clock = std::chrono::steady_clock;
+    clock::time_point last_tick = clock::now();
+
+    std::unique_lock lk(mtx);
+    while (true)
+    {
+        rate_cv.wait(lk, [this] { return stopping or ticks_per_second > 0 or !requested_steps.empty(); });
+        if (stopping)
+            return;
+
+        if (!requested_steps.empty())
+        {
+            step_request_t request = std::move(requested_steps.front());
+            requested_steps.pop_front();
+            running_steps = true;
+
+            uint32_t step = 0;
+            steps_result_t result = steps_result_t::done;
+            for (; step != request.steps and result == steps_result_t::done and !stopping; step++)
+            {
+                lk.unlock();
+                result = tick();
+                lk.lock();
+            }
+            if (result == steps_result_t::done and step != request.steps)
+                result = steps_result_t::stopped;
+
+            lk.unlock();
+            answer(request, result);
+            lk.lock();
+            running_steps = false;
+            continue;
+        }
+
+        if (ticks_per_second == UNLIMITED_RATE)
+        {
+            lk.unlock();
+            tick();
+            // Lets threads waiting on the state touched by tick_fn grab it between ticks
+            std::this_thread::yield();
+            lk.lock();
+            last_tick = clock::now();
+            continue;
+        }
+
+        // A rate change wakes the ticker up, which then recomputes its deadline
+        double current_rate = ticks_per_second;
+        auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / current_rate));
+        // Does not try to catch up on ticks missed while paused or overloaded
+        last_tick = std::max(last_tick, clock::now() - period);
+        if (rate_cv.wait_until(lk, last_tick + period, [&] { return stopping or ticks_per_second != current_rate or !requested_steps.empty(); }))
+            continue;
+
+        last_tick += period;
+        lk.unlock();
+        tick();
+        lk.lock();
+    }
+}
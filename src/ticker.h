@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+// Thread that calls a tick function at a configurable rate, so the simulation
+// can advance without a client driving every step. It also runs the ticks
+// clients ask for (request_steps()), so the threads serving requests never
+// block while a tick runs.
+class ticker_t
+{
+public:
+    static constexpr double UNLIMITED_RATE = std::numeric_limits<double>::infinity();
+
+    // Outcome of the ticks of a request_steps()
+    enum class steps_result_t
+    {
+        // All of them ran
+        done,
+        // A tick did not complete in time, which ended the run
+        timed_out,
+        // The ticker was destroyed before they all ran
+        stopped,
+        // A tick threw, which ended the run
+        failed
+    };
+
+    // `tick_fn` runs one tick and returns whether it completed in time. The
+    // exceptions it throws, and the ones of `on_done`, are reported on stderr
+    // and do not stop the ticker.
+    explicit ticker_t(std::function<bool()> tick_fn);
+    ~ticker_t();
+
+    ticker_t(const ticker_t &) = delete;
+    ticker_t &operator=(const ticker_t &) = delete;
+
+    // Sets the rate in ticks per second; 0 pauses the ticker and
+    // UNLIMITED_RATE runs ticks back to back
+    void set_rate(double ticks_per_second);
+    double rate();
+
+    // Queues `steps` ticks, run back to back; `on_done` is called on the ticker
+    // thread once they ran, or on the thread destroying the ticker if it is
+    // destroyed first. Requests run in order and before the ticks due to the
+    // rate. With 0 steps, `on_done` just runs on the ticker thread between two ticks.
+    void request_steps(uint32_t steps, std::function<void(steps_result_t)> on_done);
+
+    // Whether the ticker has steps queued or running. The ticks due to the
+    // rate do not count: nobody waits for them.
+    bool busy();
+
+private:
+    struct step_request_t
+    {
+        uint32_t steps;
+        std::function<void(steps_result_t)> on_done;
+    };
+
+    void loop();
+
+    // Runs a tick: done, timed_out or failed
+    steps_result_t tick();
+
+    // Calls the `on_done` of `request`
+    static void answer(step_request_t &request, steps_result_t result);
+
+    std::function<bool()> tick_fn;
+
+    std::mutex mtx;
+    std::condition_variable rate_cv;
+    double ticks_per_second = 0;
+    std::deque<step_request_t> requested_steps;
+    bool running_steps = false;
+    bool stopping = false;
+
+    std::thread thread;
+};
@@ -0,0 +1,212 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+#include "alloc_counter.h"
+
+namespace
+{
+    uint64_t pack_range(uint64_t begin, uint64_t end) { return begin | end << 32; }
+    uint32_t range_begin(uint64_t range) { return uint32_t(range); }
+    uint32_t range_end(uint64_t range) { return uint32_t(range >> 32); }
+}
+
+worker_pool_t::worker_pool_t(size_t num_workers)
+    : slots(std::max<size_t>(num_workers, 1)), phase_barrier(std::max<size_t>(num_workers, 1), phase_completion_t{this})
+{
+    num_workers = std::max<size_t>(num_workers, 1);
+
+    workers.reserve(num_workers);
+    for (size_t idx = 0; idx != num_workers; idx++)
+        workers.emplace_back(&worker_pool_t::worker_loop, this, idx);
+}
+
+worker_pool_t::~worker_pool_t()
+{
+    wait();
+    {
+        std::lock_guard lk(mtx);
+        stopping = true;
+    }
+    work_cv.notify_all();
+
+    for (std::thread &t : workers)
+        t.join();
+}
+
+uint64_t worker_pool_t::dispatch(const std::vector<phase_t> &new_phases)
+{
+    std::unique_lock lk(mtx);
+    // Callers get the pool in the order they asked for it
+    uint64_t work = ++queued_work;
+    done_cv.wait(lk, [&] { return completed_work + 1 == work; });
+
+    if (new_phases.empty())
+    {
+        completed_work = work;
+        done_cv.notify_all();
+        return work;
+    }
+
+    phases = &new_phases;
+    current_phase = 0;
+    split_tasks();
+    generation++;
+    work_cv.notify_all();
+    return work;
+}
+
+void worker_pool_t::wait()
+{
+    std::unique_lock lk(mtx);
+    done_cv.wait(lk, [this] { return completed_work == queued_work; });
+}
+
+void worker_pool_t::wait(uint64_t work)
+{
+    std::unique_lock lk(mtx);
+    done_cv.wait(lk, [&] { return completed_work >= work; });
+}
+
+bool worker_pool_t::wait_for(uint64_t work, std::chrono::microseconds timeout)
+{
+    if (timeout == std::chrono::microseconds::max())
+    {
+        wait(work);
+        return true;
+    }
+
+    std::unique_lock lk(mtx);
+    return done_cv.wait_for(lk, timeout, [&] { return completed_work >= work; });
+}
+
+std::vector<worker_pool_t::worker_stats_t> worker_pool_t::stats() const
+{
+    std::vector<worker_stats_t> worker_stats;
+    for (const worker_slot_t &slot : slots)
+        worker_stats.push_back({slot.tasks, slot.steals, slot.busy_ns, slot.allocations});
+    return worker_stats;
+}
+
+uint64_t worker_pool_t::allocations() const
+{
+    uint64_t total = 0;
+    for (const worker_slot_t &slot : slots)
+        total += slot.allocations.load(std::memory_order_relaxed);
+    return total;
+}
+
+void worker_pool_t::split_tasks()
+{
+    size_t num_tasks = (*phases)[current_phase].num_tasks;
+    for (size_t worker = 0; worker != slots.size(); worker++)
+        slots[worker].range = pack_range(num_tasks * worker / slots.size(), num_tasks * (worker + 1) / slots.size());
+}
+
+bool worker_pool_t::pop_task(size_t worker, size_t &task)
+{
+    std::atomic<uint64_t> &range = slots[worker].range;
+    uint64_t current = range.load();
+    while (range_begin(current) < range_end(current))
+    {
+        if (range.compare_exchange_weak(current, pack_range(range_begin(current) + 1, range_end(current))))
+        {
+            task = range_begin(current);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Steals the back half of the largest range left to another worker. The first
+// stolen task is returned and the rest becomes the range of `worker`.
+bool worker_pool_t::steal_task(size_t worker, size_t &task)
+{
+    while (true)
+    {
+        size_t victim = worker;
+        uint64_t victim_range = 0;
+        uint32_t largest = 0;
+        for (size_t idx = 0; idx != slots.size(); idx++)
+        {
+            uint64_t range = slots[idx].range.load();
+            uint32_t remaining = range_begin(range) < range_end(range) ? range_end(range) - range_begin(range) : 0;
+            if (idx != worker and remaining > largest)
+            {
+                victim = idx;
+                victim_range = range;
+                largest = remaining;
+            }
+        }
+
+        if (largest == 0)
+            return false;
+
+        uint32_t begin = range_begin(victim_range);
+        uint32_t end = range_end(victim_range);
+        uint32_t middle = begin + (end - begin) / 2;
+        if (!slots[victim].range.compare_exchange_strong(victim_range, pack_range(begin, middle)))
+            continue;
+
+        // Our own range is empty, so no thief touches it until it is stored
+        slots[worker].range = pack_range(middle + 1, end);
+        slots[worker].steals.fetch_add(1, std::memory_order_relaxed);
+        task = middle;
+        return true;
+    }
+}
+
+// Runs on exactly one worker once every worker reached the barrier
+void worker_pool_t::complete_phase() noexcept
+{
+    if (++current_phase != phases->size())
+    {
+        split_tasks();
+        return;
+    }
+
+    std::lock_guard lk(mtx);
+    completed_work++;
+    done_cv.notify_all();
+}
+
+void worker_pool_t::worker_loop(size_t worker)
+{
+    uint64_t seen_generation = 0;
+
+    while (true)
+    {
+        size_t num_phases;
+        {
+            std::unique_lock lk(mtx);
+            work_cv.wait(lk, [&] { return stopping or generation != seen_generation; });
+            if (stopping)
+                return;
+
+            seen_generation = generation;
+            num_phases = phases->size();
+        }
+
+        for (size_t phase = 0; phase != num_phases; phase++)
+        {
+            // current_phase only changes inside the barrier completion
+            const phase_t &p = (*phases)[current_phase];
+
+            // Run our own tasks, then help the others until the phase is exhausted
+            size_t task;
+            while (pop_task(worker, task) or steal_task(worker, task))
+            {
+                auto task_start = std::chrono::steady_clock::now();
+                uint64_t allocations_before = thread_heap_allocations();
+                p.task(task);
+                uint64_t task_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - task_start).count();
+
+                slots[worker].tasks.fetch_add(1, std::memory_order_relaxed);
+                slots[worker].busy_ns.fetch_add(task_ns, std::memory_order_relaxed);
+                slots[worker].allocations.fetch_add(thread_heap_allocations() - allocations_before, std::memory_order_relaxed);
+            }
+
+            phase_barrier.arrive_and_wait();
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads used by the tick engine.
+// The threads are created once and reused for every tick, so the cost of a
+// tick no longer depends on how many entities are alive.
+//
+// Work is dispatched as a list of phases. Every worker drains the tasks of a
+// phase and then blocks on a std::barrier until all workers are done with it,
+// so a phase only starts once the previous one is complete.
+//
+// The tasks of a phase are split into one contiguous range per worker, which
+// keeps neighboring tasks (tiles) on the same worker. A worker takes tasks from
+// the front of its own range; once it runs dry it steals the back half of the
+// largest remaining range, so uneven tasks do not leave workers idle.
+//
+// Several simulations can share the pool. Their work runs one dispatch at a
+// time, in the order it was dispatched, so every simulation waiting for the
+// pool gets its turn before any of them gets a second one.
+class worker_pool_t
+{
+public:
+    using task_t = std::function<void(size_t)>;
+
+    struct phase_t
+    {
+        size_t num_tasks;
+        task_t task;
+    };
+
+    // Counters of a worker since the pool was created
+    struct worker_stats_t
+    {
+        uint64_t tasks = 0;
+        uint64_t steals = 0;
+        uint64_t busy_ns = 0;
+        // Heap allocations made by the tasks
+        uint64_t allocations = 0;
+    };
+
+    // Creates `num_workers` threads (defaults to the number of cores)
+    explicit worker_pool_t(size_t num_workers = std::thread::hardware_concurrency());
+    ~worker_pool_t();
+
+    worker_pool_t(const worker_pool_t &) = delete;
+    worker_pool_t &operator=(const worker_pool_t &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Starts running the phases in order and returns the id of the work.
+    // Waits for the work dispatched before first. The pool refers to `phases`
+    // until the work is done, so dispatching does not allocate; the caller
+    // keeps them alive until then.
+    uint64_t dispatch(const std::vector<phase_t> &phases);
+
+    // Blocks until all the dispatched work is done
+    void wait();
+
+    // Blocks until the work `work` (and all the work dispatched before it) is done
+    void wait(uint64_t work);
+
+    // Same as wait(work), but gives up after `timeout` (microseconds::max() waits forever).
+    // Returns whether the work is done.
+    bool wait_for(uint64_t work, std::chrono::microseconds timeout);
+
+    // Snapshot of the counters of every worker
+    std::vector<worker_stats_t> stats() const;
+
+    // Heap allocations made by the tasks of every worker since the pool was created
+    uint64_t allocations() const;
+
+private:
+    struct phase_completion_t
+    {
+        worker_pool_t *pool;
+        void operator()() noexcept { pool->complete_phase(); }
+    };
+
+    // Range of task indices [begin, end) left to a worker, packed as begin | end << 32
+    // so that the owner and thieves can update it with a single CAS
+    struct alignas(64) worker_slot_t
+    {
+        std::atomic<uint64_t> range = 0;
+        std::atomic<uint64_t> tasks = 0;
+        std::atomic<uint64_t> steals = 0;
+        std::atomic<uint64_t> busy_ns = 0;
+        std::atomic<uint64_t> allocations = 0;
+    };
+
+    void worker_loop(size_t worker);
+    void complete_phase() noexcept;
+
+    // Splits the tasks of the current phase between the workers
+    void split_tasks();
+    bool pop_task(size_t worker, size_t &task);
+    bool steal_task(size_t worker, size_t &task);
+
+    std::vector<std::thread> workers;
+    std::vector<worker_slot_t> slots;
+    std::barrier<phase_completion_t> phase_barrier;
+
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+
+    const std::vector<phase_t> *phases = nullptr;
+    size_t current_phase = 0;
+    uint64_t generation = 0;
+    // Ids of the last work dispatched, including callers still waiting for their turn, and of the last one done
+    uint64_t queued_work = 0;
+    uint64_t completed_work = 0;
+    bool stopping = false;
+};
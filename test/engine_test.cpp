@@ -0,0 +1,248 @@
+// Checks of the tick engine, run by ctest. Prints the failed checks and
+// exits with 1 if any failed.
+//
+//   - ticks do not allocate: tick_metrics_t::last_tick_allocations is 0
+//   - a seed gives the same grids whatever the number of workers
+//   - a keyframe and the deltas after it rebuild the grid (frame_codec.h)
+//   - params_from_json() refuses unknown keys and values out of range
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "frame_codec.h"
+#include "params_json.h"
+#include "simulation.h"
+
+namespace
+{
+    // Spans several tiles in both directions, and neither side is a multiple of a tile
+    const uint32_t TEST_WIDTH = 300;
+    const uint32_t TEST_HEIGHT = 100;
+    const uint32_t TEST_TICKS = 50;
+    const uint64_t TEST_SEED = 7;
+
+    int failures = 0;
+
+    void check(bool ok, const std::string &what)
+    {
+        if (ok)
+            return;
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+
+    std::string at_tick(uint32_t tick, const char *what)
+    {
+        return "tick " + std::to_string(tick) + ": " + what;
+    }
+
+    void start(simulation_t &simulation)
+    {
+        simulation.start(TEST_WIDTH, TEST_HEIGHT, 6000, 3000, 1000, TEST_SEED);
+    }
+
+    bool same_grid(const simulation_t &a, const simulation_t &b)
+    {
+        for (uint32_t i = 0; i != a.height(); i++)
+            for (uint32_t j = 0; j != a.width(); j++)
+            {
+                entity_t x = a.at(i, j), y = b.at(i, j);
+                if (x.type != y.type or x.energy != y.energy or x.age != y.age or x.last_tick != y.last_tick)
+                    return false;
+            }
+        return true;
+    }
+
+    void test_ticks_do_not_allocate()
+    {
+        worker_pool_t pool(4);
+        simulation_t simulation(pool);
+        start(simulation);
+
+        for (uint32_t tick = 1; tick <= TEST_TICKS; tick++)
+        {
+            simulation.step();
+            check(simulation.metrics().last_tick_allocations == 0, at_tick(tick, "tick allocated"));
+        }
+    }
+
+    void test_workers_do_not_change_the_run()
+    {
+        worker_pool_t single_pool(1), multi_pool(4);
+        simulation_t single(single_pool), multi(multi_pool);
+        start(single);
+        start(multi);
+
+        for (uint32_t tick = 1; tick <= TEST_TICKS; tick++)
+        {
+            single.step();
+            multi.step();
+            check(same_grid(single, multi), at_tick(tick, "grids of 1 and 4 workers differ"));
+            for (entity_type_t type : ALL_SPECIES)
+                check(single.population(type) == multi.population(type), at_tick(tick, "populations of 1 and 4 workers differ"));
+        }
+        check(single.population(herbivore) != 0, "herbivores died out, the test checks little");
+    }
+
+    // Client side of the binary frames: the cells of the grid, row-major
+    struct decoded_grid_t
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t tick = 0;
+        std::vector<entity_t> cells;
+    };
+
+    struct frame_reader_t
+    {
+        const std::string &frame;
+        size_t offset = 0;
+
+        uint32_t u8() { return uint8_t(frame.at(offset++)); }
+        uint32_t u16() { return u8() | u8() << 8; }
+        uint32_t u32() { return u16() | u16() << 16; }
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (uint32_t shift = 0;; shift += 7)
+            {
+                uint32_t byte = u8();
+                value |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+        }
+
+        int32_t zigzag()
+        {
+            uint32_t value = uint32_t(varint());
+            return int32_t(value >> 1) ^ -int32_t(value & 1);
+        }
+    };
+
+    // Applies a frame to `grid` as a client does. Returns false if the frame is malformed.
+    bool apply_frame(const std::string &frame, decoded_grid_t &grid)
+    {
+        frame_reader_t reader{frame};
+        if (reader.u8() != FRAME_VERSION)
+            return false;
+        uint32_t flags = reader.u8();
+        uint32_t width = reader.u16(), height = reader.u16();
+        reader.u32(); // run
+        uint32_t tick = reader.u32();
+        reader.u32(); // base tick
+        uint32_t num_records = reader.u32();
+
+        if (flags & FRAME_KEYFRAME)
+            grid = {width, height, tick, std::vector<entity_t>(size_t(width) * height, entity_t{empty, 0, 0, 0})};
+        else if (width != grid.width or height != grid.height)
+            return false;
+        grid.tick = tick;
+
+        uint64_t cell = 0;
+        for (uint32_t record = 0; record != num_records; record++)
+        {
+            cell += reader.varint();
+            if (cell >= grid.cells.size())
+                return false;
+
+            entity_t e = {entity_type_t(reader.u8()), 0, 0, 0};
+            if (e.type != empty)
+            {
+                e.energy = reader.zigzag();
+                e.age = int32_t(reader.varint());
+            }
+            grid.cells[cell++] = e;
+        }
+        return reader.offset == frame.size();
+    }
+
+    bool matches(const decoded_grid_t &grid, const simulation_t &simulation)
+    {
+        if (grid.width != simulation.width() or grid.height != simulation.height() or grid.tick != simulation.current_tick())
+            return false;
+        for (uint32_t i = 0; i != grid.height; i++)
+            for (uint32_t j = 0; j != grid.width; j++)
+            {
+                entity_t x = grid.cells[size_t(i) * grid.width + j], y = simulation.at(i, j);
+                if (x.type != y.type or (y.type != empty and (x.energy != y.energy or x.age != y.age)))
+                    return false;
+            }
+        return true;
+    }
+
+    void test_frames_rebuild_the_grid()
+    {
+        worker_pool_t pool(4);
+        simulation_t simulation(pool);
+        start(simulation);
+
+        decoded_grid_t grid;
+        check(apply_frame(encode_keyframe(simulation), grid) and matches(grid, simulation), at_tick(0, "keyframe does not match the grid"));
+
+        // Deltas of one tick, of several ticks, and a keyframe over a grid that
+        // has changed since, which must replace it rather than be merged into it
+        uint64_t emptied = 0;
+        for (uint32_t tick = 1; tick <= TEST_TICKS; tick++)
+        {
+            simulation.step();
+            if (tick % 5 == 0)
+                continue;
+
+            bool several_ticks = grid.tick + 1 != tick;
+            std::string frame = tick % 7 == 0 ? encode_keyframe(simulation) : encode_delta(simulation, grid.tick);
+            for (uint32_t i = 0; i != simulation.height(); i++)
+                for (uint32_t j = 0; j != simulation.width(); j++)
+                    emptied += grid.cells[size_t(i) * grid.width + j].type != empty and simulation.at(i, j).type == empty;
+
+            check(apply_frame(frame, grid), at_tick(tick, "malformed frame"));
+            check(matches(grid, simulation), at_tick(tick, several_ticks ? "frame of several ticks does not match the grid" : "frame does not match the grid"));
+        }
+        check(emptied != 0, "no cell became empty, the test checks little");
+
+        // Restarting on another grid size takes a keyframe
+        simulation.start(TEST_WIDTH / 2, TEST_HEIGHT * 2, 100, 50, 10, TEST_SEED);
+        check(apply_frame(encode_keyframe(simulation), grid) and matches(grid, simulation), "keyframe of a restarted run does not match the grid");
+    }
+
+    void test_params_from_json()
+    {
+        auto accepts = [](const char *text)
+        {
+            simulation_params_t params;
+            std::string error;
+            return params_from_json(nlohmann::json::parse(text), params, error);
+        };
+
+        check(accepts(R"({})"), "empty parameters refused");
+        check(accepts(R"({"move_energy": 0, "herbivore": {"energy_gain": 32767, "eat_probability": 1}})"), "parameters at their limits refused");
+        for (const char *refused : {R"({"move_energy": -1})", R"({"start_energy": 32768})", R"({"move_energy": 1.5})",
+                                    R"({"plant": {"maximum_age": 40000}})", R"({"carnivore": {"move_probability": 1.01}})",
+                                    R"({"herbivore": {"reproduction_probability": -0.1}})", R"({"herbivore": {"energy_gain": "30"}})",
+                                    R"({"speed": 1})", R"({"fungus": {}})", R"({"herbivore": {"wings": 2}})",
+                                    R"({"plant": {"move_probability": 0.5}})", R"({"plant": {"energy_gain": 10}})",
+                                    R"({"plant": 1})", R"([])"})
+            check(!accepts(refused), std::string("parameters accepted: ") + refused);
+
+        // Values are read into the parameters, the other keys keep theirs
+        simulation_params_t params;
+        std::string error;
+        params_from_json(nlohmann::json::parse(R"({"move_energy": 7, "herbivore": {"maximum_age": 40}})"), params, error);
+        check(params.move_energy == 7 and params.of(herbivore).maximum_age == 40 and params.of(carnivore).maximum_age == int32_t(CARNIVORE_MAXIMUM_AGE),
+              "parameters not read");
+    }
+}
+
+int main()
+{
+    test_ticks_do_not_allocate();
+    test_workers_do_not_change_the_run();
+    test_frames_rebuild_the_grid();
+    test_params_from_json();
+
+    if (failures == 0)
+        std::printf("All checks passed\n");
+    return failures == 0 ? 0 : 1;
+}